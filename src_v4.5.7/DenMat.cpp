@@ -1,4 +1,5 @@
 #include "DenMat.h"
+#include "checkpoint.h"
 
 template <typename T> int sgn(T val) {
 	return (T(0) < val) - (val < T(0));
@@ -46,7 +47,8 @@ void singdenmat_k::evolve_coh(double t, complex** ddmdt_coh){
 			commutator_mat_diag(ddmdt_coh[ik_glob], e[ik_glob], dm[ik_glob], nb, cmi);
 	}
 
-	mp->allreduce(ddmdt_coh, nk_glob, nb*nb, MPI_SUM);
+	if (alg.distribute_dm) mp->allgather(ddmdt_coh, nk_glob, nb*nb); // rows are computed by their owners only
+	else mp->allreduce(ddmdt_coh, nk_glob, nb*nb, MPI_SUM);
 }
 void singdenmat_k::compute_Hcoht(double t, complex *Hk, double *ek){
 		for (int i = 0; i < nb; i++)
@@ -118,9 +120,23 @@ void singdenmat_k::set_dm_eq(double temperature, double **e, int nv){
 		}
 	}
 
+	if (dm_eq_buf == nullptr){
+		for (int ik = 0; ik < nk_glob; ik++)
+		  for (int i = 0; i < nb; i++)
+		  	dm_eq[ik][i*nb + i] = f_eq[ik][i];
+		return;
+	}
+	// with alg_shm_arrays (called in every right-hand side during a laser), node rank 0 writes the copy not in use
+	// and all processes switch to it after one sync; that copy was last read before the sync of the previous call
+	int next = 1 - dm_eq_cur;
+	if (node_shm::writer())
 	for (int ik = 0; ik < nk_glob; ik++)
 	  for (int i = 0; i < nb; i++)
-	  	dm_eq[ik][i*nb + i] = f_eq[ik][i];
+	  	dm_eq_buf[next*nk_glob + ik][i*nb + i] = f_eq[ik][i];
+	node_shm::sync();
+	for (int ik = 0; ik < nk_glob; ik++)
+		dm_eq[ik] = dm_eq_buf[next*nk_glob + ik];
+	dm_eq_cur = next;
 }
 void singdenmat_k::set_dm_eq(bool isHole, double temperature, double mu0, double **e, int bStart, int bEnd){
 	double nfree_bvk = 0.;
@@ -300,13 +316,8 @@ void singdenmat_k::use_dmDP(double **f){
 */
 
 void singdenmat_k::read_dm_restart(){
-	if (ionode) printf("\nread denmat_restart.bin:\n");
-	FILE *fp = fopen("restart/denmat_restart.bin", "rb");
-	size_t expected_size = nk_glob*nb*nb * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "denmat_restart.bin size does not match expected size");
-	for (int ik = 0; ik < nk_glob; ik++)
-		fread(dm[ik], 2 * sizeof(double), nb*nb, fp);
-	fclose(fp);
+	dm_checkpoint ckpt(mp, nk_glob, nb, false);
+	ckpt.read(dm);
 
 	for (int ik = 0; ik < nk_glob; ik++){
 		for (int i = 0; i < nb; i++)
@@ -316,23 +327,6 @@ void singdenmat_k::read_dm_restart(){
 			oneminusdm[ik][i*nb + i] = c1 - dm[ik][i*nb + i];
 	}
 }
-void singdenmat_k::write_dm_tofile(double t){
-	MPI_Barrier(MPI_COMM_WORLD);
-	if (!ionode) return;
-	//FILE *fil = fopen("denmat.out", "a"); // will be too large after long time
-	FILE *filbin = fopen("restart/denmat_restart.bin", "wb");
-	FILE *filtime = fopen("restart/time_restart.dat", "w"); fprintf(filtime, "%14.7le", t);
-	//fprintf(fil, "Writing density matrix at time %10.3e:\n", t);
-	for (int ik = 0; ik < nk_glob; ik++)//{
-		//for (int i = 0; i < nb*nb; i++)
-			//fprintf(fil, "(%15.7e,%15.7e) ", dm[ik][i].real(), dm[ik][i].imag());
-		fwrite(dm[ik], 2 * sizeof(double), nb*nb, filbin);
-		//fprintf(fil, "\n");
-	//}
-	//fflush(fil);
-	//fclose(fil); 
-	fclose(filbin); fclose(filtime);
-}
 void singdenmat_k::write_dm(){
 	MPI_Barrier(MPI_COMM_WORLD);
 	if (!ionode) return;
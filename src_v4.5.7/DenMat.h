@@ -31,8 +31,14 @@ public:
 	mymp *mp;
 	electron *elec;
 	int nk_glob, ik0_glob, ik1_glob, nk_proc, nb;
+	// all rows (nk_glob) are kept on every process, also with alg.distribute_dm: dm, oneminusdm, ddmdt, ddmdt_term, dm_eq and f_eq
+	// alg.distribute_dm only shrinks the e-ph accumulators to halo rows; the coherent, laser and e-ph terms of ddmdt are then
+	// completed on the owners of the rows and allgathered to all processes
 	complex **dm, **oneminusdm, **ddmdt, **ddmdt_term, **dm_eq;
 	double mue, muh, **f_eq, ne, nh;
+	// with alg_shm_arrays: two node-shared copies of dm_eq (rows ik and nk_glob + ik); the rows of dm_eq point to the current one
+	complex **dm_eq_buf;
+	int dm_eq_cur;
 
 	singdenmat_k(parameters *param, mymp *mp, electron *elec)
 		:denmat(param), mp(mp), elec(elec),
@@ -50,7 +56,16 @@ public:
 		oneminusdm = alloc_array(nk_glob, nb*nb);
 		ddmdt = alloc_array(nk_glob, nb*nb);
 		ddmdt_term = alloc_array(nk_glob, nb*nb);
-		dm_eq = alloc_array(nk_glob, nb*nb);
+		if (node_shm::enabled){ // the same on all processes, only set in set_dm_eq
+			dm_eq_buf = node_shm::alloc_array(2 * nk_glob, nb*nb); dm_eq_cur = 0;
+			dm_eq = new complex*[nk_glob];
+			for (int ik = 0; ik < nk_glob; ik++)
+				dm_eq[ik] = dm_eq_buf[ik];
+		}
+		else{
+			dm_eq_buf = nullptr;
+			dm_eq = alloc_array(nk_glob, nb*nb);
+		}
 		f_eq = alloc_real_array(nk_glob, nb);
 	}
 
@@ -84,7 +99,6 @@ public:
 
 	void write_ddmdt(std::vector<vector3<double>> kvec, std::vector<int> ik_kpath, double **e);
 	void write_dm();
-	void write_dm_tofile(double t);
 
 	// coherent dynamics
 	complex **Hcoh, *Hcoht;
@@ -10,6 +10,7 @@
 #include "phenomenon_relax.h"
 #include "DenMat.h"
 #include "observable.h"
+#include "checkpoint.h"
 #include "material_model.h"
 
 template<class Tl, class Te, class Telight, class Teph>
@@ -27,20 +28,36 @@ public:
 	singdenmat_k* sdmk;
 	ob_1dmk<Tl, Te>* ob;
 	double *tau_neq;
+	workspace ws; //<! scratch arrays of the right-hand side, reused by all calls of compute
+	dm_checkpoint *ckpt, *ckpt_scatt;
+	restart_state rs; //<! state of the last completed step, saved with each checkpoint
+	complex **dm_scatt; //<! dm of the last update of the scattering models outside the right-hand side
 
 	dm_dynamics(Tl* latt, parameters* param, Te* elec, Telight* elight, Teph* eph)
 		: latt(latt), param(param), elec(elec), elight(elight), eph(eph)
 	{
+		eph->ws = &ws;
+		eph->reserve_workspace();
+		if (ionode) printf("scratch workspace of the right-hand side: %.3lf MB per process\n", ws.bytes_total() / 1048576.);
+
 		// density matrix
 		sdmk = new singdenmat_k(param, &mpk, elec); //<! k-independent single density matrix
+		ckpt = new dm_checkpoint(&mpk, sdmk->nk_glob, sdmk->nb, param->checkpoint_async);
+		ckpt_scatt = nullptr; dm_scatt = nullptr;
 		//if (alg.use_dmDP_in_evolution) sdmk->init_dmDP(elec->ddm_Bpert, elec->ddm_Bpert_neq);
 		sdmk->init_Hcoh(elec->H_BS, elec->H_Ez, elec->e_dm);
 		// probe ground state
 		sdmk->init_dm(elec->f_dm);
 		if (pmp.active()) elight->probe(-1, sdmk->t, sdmk->dm, sdmk->oneminusdm);
 		// initialize density matrix with spin imbalance
-		if (param->restart)
+		if (param->restart){
 			sdmk->read_dm_restart();
+			if (rs.read("restart/state_restart.dat")){
+				sdmk->mue = rs.mue; sdmk->muh = rs.muh;
+				if (ionode) printf("restart from step %d, next step size %lg fs\n", rs.it, rs.h / fs);
+			}
+			else if (ionode) printf("restart/state_restart.dat does not exist, restart with step 1 and ode_hstart\n");
+		}
 		else{
 			if (pmp.active() && pmp.laserAlg == "perturb"){
 				if (ionode) printf("initial density matrix inbalance is induced by pump (Gaussian) pulse perturbation\n");
@@ -70,6 +87,7 @@ public:
 		ob = new ob_1dmk<Tl, Te>(latt, param, elec, eph->bStart, eph->bEnd);
 		report(0, false, false, true); //!< report initial quatities: dos, occupation, spin, probe to stdout
 		if (!param->restart) report(0); //!< write initial excess quantities in files
+		if (param->restart && rs.it_scatt > 0) restore_scatt();
 
 		// compute relaxtion according to intial density matrix
 		if (param->compute_tau_only){ compute(sdmk->t); report_tau(0); } // compute initial relaxation time
@@ -182,8 +200,13 @@ public:
 		if (ionode) printf("==================================================\n");
 		if (ionode) printf("==================================================\n");
 
-		for (double it = 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0)
+		for (double it = rs.it + 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0){
+			ws.reset_counter();
 			evolve_euler_one_step(it);
+			if (checkpoint(it, 0)) break;
+			report_workspace();
+		}
+		checkpoint(rs.it, 0, true);
 	}
 
 	void evolve_gsl(){
@@ -199,15 +222,17 @@ public:
 		gsl_odeiv2_system sys = { func<Tl, Te, Telight, Teph>, NULL, size_y, this };
 		gsl_odeiv2_driver* d = gsl_odeiv2_driver_alloc_y_new(&sys, gsl_odeiv2_step_rkf45, ode.hstart, ode.epsabs, 0.0);
 		gsl_odeiv2_driver_set_hmin(d, ode.hmin);
+		if (rs.h > 0) gsl_odeiv2_driver_reset_hstart(d, rs.h);
 		if (pmp.active() && elight->during_laser(sdmk->t)) gsl_odeiv2_driver_set_hmax(d, ode.hmax_laser);
 		else gsl_odeiv2_driver_set_hmax(d, ode.hmax);
-		double y[size_y];
+		double *y = alloc_aligned_real_array(size_y); // heap: nk_glob*nb^2*2 doubles easily exceed the stack limit
 		copy_real_from_complex(y, sdmk->dm, size_y / 2);
 
 		// evolution
 		MPI_Barrier(MPI_COMM_WORLD);
 		double ti = sdmk->t;
-		for (int it = 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0){
+		for (int it = rs.it + 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0){
+			ws.reset_counter();
 			if ((it-1) % ob->freq_compute_tau == 0){ compute(sdmk->t); report_tau(it); ode.ncalls = 0; } // notice that you need to call subroutine "compute" before "report_tau"
 			ti += dt_current();
 			if (pmp.active()){
@@ -220,8 +245,142 @@ public:
 			if (status != GSL_SUCCESS) throw std::invalid_argument("!GSL_SUCCESS");
 			{ copy_complex_from_real(sdmk->dm, y, size_y / 2); report(it); } // ensure dm is at current time
 			if (ionode) printf("ncalls= %d at ti= %lg fs\n", ode.ncalls, ti / fs);
+			if (checkpoint(it, d->h)) break;
+			report_workspace();
 		}
+		checkpoint(rs.it, d->h, true);
 		gsl_odeiv2_driver_free(d);
+		dealloc_aligned_real_array(y);
+	}
+
+	void evolve_ros2(){
+		MPI_Barrier(MPI_COMM_WORLD);
+		if (ionode) printf("\n==================================================\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("start density matrix evolution (stiff Rosenbrock method ros2)\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("==================================================\n");
+
+		// set ODE solver
+		// with alg.linearize and without laser, the right-hand side is affine in dm and the Jacobian-vector products are exact
+		size_t size_y = sdmk->nk_glob*(size_t)std::pow(sdmk->nb, 2) * 2;
+		// f depends on t explicitly through the laser and, in the interaction picture, through the exp(iwt) factors
+		// of the scattering terms (alg.expt) and of the coherent terms (compute_Hcoht)
+		bool affine = alg.linearize && !pmp.active();
+		bool autonomous = !alg.expt && !pmp.active() && (alg.picture == "schrodinger" || !(elec->H_BS || elec->H_Ez));
+		ode_ros2 d(func<Tl, Te, Telight, Teph>, this, size_y, ode.hstart, ode.epsabs, affine, autonomous, ode.krylov_dim, ode.krylov_tol);
+		d.set_hmin(ode.hmin);
+		if (rs.h > 0) d.set_step(rs.h);
+		if (pmp.active() && elight->during_laser(sdmk->t)) d.set_hmax(ode.hmax_laser);
+		else d.set_hmax(ode.hmax);
+		double *y = alloc_aligned_real_array(size_y);
+		copy_real_from_complex(y, sdmk->dm, size_y / 2);
+
+		// evolution
+		MPI_Barrier(MPI_COMM_WORLD);
+		double ti = sdmk->t;
+		for (int it = rs.it + 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0){
+			ws.reset_counter();
+			if ((it-1) % ob->freq_compute_tau == 0){ compute(sdmk->t); report_tau(it); ode.ncalls = 0; } // notice that you need to call subroutine "compute" before "report_tau"
+			ti += dt_current();
+			if (pmp.active()){
+				if (elight->enter_laser(sdmk->t, ti)) d.set_hmax(ode.hmax_laser);
+				if (elight->leave_laser(sdmk->t, ti)) d.set_hmax(ode.hmax);
+			}
+			update_scatt_outside(sdmk->t, it);
+
+			int nsteps = d.nsteps, nrejects = d.nrejects, nkrylov = d.nkrylov;
+			int status = d.apply(&sdmk->t, ti, y);
+			if (status != 0) error_message("ros2 step size underflow", "evolve_ros2");
+			{ copy_complex_from_real(sdmk->dm, y, size_y / 2); report(it); } // ensure dm is at current time
+			if (ionode) printf("ncalls= %d steps= %d rejected= %d krylov iterations= %d at ti= %lg fs\n",
+				ode.ncalls, d.nsteps - nsteps, d.nrejects - nrejects, d.nkrylov - nkrylov, ti / fs);
+			if (checkpoint(it, d.step())) break;
+			report_workspace();
+		}
+		checkpoint(rs.it, d.step(), true);
+		dealloc_aligned_real_array(y);
+	}
+
+	void evolve_expmv(){
+		MPI_Barrier(MPI_COMM_WORLD);
+		if (ionode) printf("\n==================================================\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("start density matrix evolution (Krylov exponential propagator)\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("==================================================\n");
+
+		// the right-hand side is the fixed affine operator of the linearized mode; each matvec is one call of compute
+		size_t size_y = sdmk->nk_glob*(size_t)std::pow(sdmk->nb, 2) * 2;
+		ode_expmv d(func<Tl, Te, Telight, Teph>, this, size_y, ode.epsabs, ode.krylov_dim);
+		if (rs.h > 0) d.set_step(rs.h);
+		double *y = alloc_aligned_real_array(size_y);
+		copy_real_from_complex(y, sdmk->dm, size_y / 2);
+
+		// evolution
+		MPI_Barrier(MPI_COMM_WORLD);
+		double ti = sdmk->t;
+		for (int it = rs.it + 1; sdmk->t < sdmk->tend; it += 1, ode.ncalls = 0){
+			ws.reset_counter();
+			if ((it-1) % ob->freq_compute_tau == 0){ compute(sdmk->t); report_tau(it); ode.ncalls = 0; } // notice that you need to call subroutine "compute" before "report_tau"
+			ti += dt_current();
+
+			int nsteps = d.nsteps, nmatvec = d.nmatvec;
+			int status = d.apply(&sdmk->t, ti, y);
+			if (status != 0) error_message("Krylov exponential propagator cannot reach ode_epsabs", "evolve_expmv");
+			{ copy_complex_from_real(sdmk->dm, y, size_y / 2); report(it); } // ensure dm is at current time
+			if (ionode) printf("ncalls= %d substeps= %d matvecs= %d at ti= %lg fs\n", ode.ncalls, d.nsteps - nsteps, d.nmatvec - nmatvec, ti / fs);
+			if (checkpoint(it, d.step())) break;
+			report_workspace();
+		}
+		checkpoint(rs.it, d.step(), true);
+		dealloc_aligned_real_array(y);
+	}
+
+	void compute_eigenmodes(){
+		MPI_Barrier(MPI_COMM_WORLD);
+		if (ionode) printf("\n==================================================\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("slowest-decaying eigenmodes of the linearized operator\n");
+		if (ionode) printf("==================================================\n");
+		if (ionode) printf("==================================================\n");
+
+		// Arnoldi on exp(eig_tau A); every application of A is one call of compute on the existing k-pair partition
+		size_t size_y = sdmk->nk_glob*(size_t)std::pow(sdmk->nb, 2) * 2;
+		ode_slowmodes es(func<Tl, Te, Telight, Teph>, this, size_y, param->eig_tau, ode.epsabs, ode.krylov_dim, param->eig_krylov_dim);
+		// start from the initial perturbation dm - dm_eq, which has the spin imbalance of interest
+		double *v0 = alloc_aligned_real_array(size_y), *yeq = alloc_aligned_real_array(size_y);
+		copy_real_from_complex(v0, sdmk->dm, size_y / 2); copy_real_from_complex(yeq, sdmk->dm_eq, size_y / 2);
+		axbyc(v0, yeq, size_y, -1., 1.);
+		int nconv = es.solve(v0, param->eig_nmodes, param->eig_nrestart, param->eig_tol);
+		dealloc_aligned_real_array(v0); dealloc_aligned_real_array(yeq);
+		if (ionode) printf("%d of %d modes converged after %d restarts and %d matvecs\n", nconv, (int)es.lambda.size(), es.nrestart_done, es.nmatvec);
+
+		FILE *fp = ionode ? fopen("eigenmodes.out", "w") : nullptr;
+		if (ionode) fprintf(fp, "#mode, Re(lambda) (au), Im(lambda) (au), tau (ps), omega (rad/ps), residual, |sx|, |sy|, |sz| (spin of the normalized mode)\n");
+		for (int im = 0; im < (int)es.lambda.size(); im++){
+			vector3<double> sabs;
+			for (int id = 0; id < 3; id++)
+				sabs[id] = complex(spin_of(es.x_re[im].data(), id), spin_of(es.x_im[im].data(), id)).abs();
+			double rate = -es.lambda[im].real(), tau = rate > 0 ? 1. / rate / ps : INFINITY;
+			if (ionode) printf("mode %d: tau= %lg ps omega= %lg rad/ps residual= %.2le |s|= %lg %lg %lg\n",
+				im, tau, es.lambda[im].imag() * ps, es.residual[im], sabs[0], sabs[1], sabs[2]);
+			if (ionode) fprintf(fp, "%d %21.14le %21.14le %14.7le %14.7le %10.3le %14.7le %14.7le %14.7le\n",
+				im, es.lambda[im].real(), es.lambda[im].imag(), tau, es.lambda[im].imag() * ps, es.residual[im], sabs[0], sabs[1], sabs[2]);
+		}
+		if (ionode) fclose(fp);
+	}
+	// Tr(s_id dm) of a density matrix stored as a real vector (see copy_real_from_complex)
+	double spin_of(const double *y, int id){
+		int nb = sdmk->nb;
+		double tot = 0;
+		for (int ik = 0; ik < sdmk->nk_glob; ik++)
+		for (int i = 0; i < nb; i++)
+		for (int b = 0; b < nb; b++){
+			size_t ibi = ((size_t)ik*nb*nb + b*nb + i) * 2;
+			tot += real(complex(y[ibi], y[ibi + 1]) * elec->s[ik][id][i*nb + b]);
+		}
+		return tot;
 	}
 
 	void evolve_euler_one_step(int it){
@@ -233,6 +392,33 @@ public:
 		report(it);
 	}
 
+	// restart checkpoint every freq_checkpoint steps, at the end of the evolution and when the file EXIT_DMD exists
+	// (user can "touch EXIT_DMD" to exit the program after the current step); returns true if the evolution should stop
+	// h: next step size of the adaptive integrator, 0 if none
+	bool checkpoint(int it, double h, bool last = false){
+		rs.it = it; rs.t = sdmk->t; rs.h = h; rs.mue = sdmk->mue; rs.muh = sdmk->muh;
+		int stop = exists("EXIT_DMD") ? 1 : 0;
+		MPI_Allreduce(MPI_IN_PLACE, &stop, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD); // all processes stop at the same step
+		if (stop && ionode){ system("rm -f EXIT_DMD"); printf("EXIT_DMD found, write checkpoint at t= %lg fs and exit\n", sdmk->t / fs); }
+		last = last || stop;
+		if (last || (param->freq_checkpoint > 0 && it % param->freq_checkpoint == 0)){
+			// the scattering dm first, so that state_restart.dat never refers to a newer one
+			if (rs.it_scatt > 0) ckpt_scatt->write(rs.t_scatt, dm_scatt);
+			ckpt->write(sdmk->t, sdmk->dm, &rs);
+		}
+		if (last){
+			if (ckpt_scatt != nullptr) ckpt_scatt->finish();
+			ckpt->finish();
+		}
+		return stop;
+	}
+
+	// once the workspace is warmed up, RHS calls should not allocate
+	void report_workspace(){
+		if (ws.bytes_alloc == 0 || ode.ncalls == 0) return;
+		if (ionode) printf("workspace grew by %lu bytes in %d RHS calls (%.1lf bytes per call)\n", ws.bytes_alloc, ode.ncalls, (double)ws.bytes_alloc / ode.ncalls);
+	}
+
 	double dt_tiny(){
 		return std::min(ode.hstart, std::min(sdmk->dt / 10, sdmk->dt_laser / 10));
 	}
@@ -241,7 +427,6 @@ public:
 	}
 
 	void compute(double t, bool active_coh = true){
-		if (exists("EXIT_DMD")){ { if (ionode) system("rm EXIT_DMD"); } mpkpair.mpi_abort("clean exit", 0); } // user can "touch EXIT_DMD to exit the program"
 		sdmk->t = t; ode.ncalls++;
 		if (ionode && ode.ncalls > 12 && ode.ncalls % 6 == 0) { printf("t= %lg fs\n", t / fs); fflush(stdout); }
 
@@ -263,7 +448,7 @@ public:
 			update_scatt_inside(sdmk->t);
 			if (pmp.active() && pmp.laserAlg != "perturb" && elight->during_laser(t)){
 				if (alg.ddmdteq || alg.phenom_relax || update_eimp_model_inside(t)) sdmk->set_dm_eq(param->temperature, elec->e_dm, elec->nv_dm);
-				if (alg.ddmdteq) eph->compute_ddmdt_eq(sdmk->f_eq); // compute time derivative of density matrix in equilibrium
+				if (alg.ddmdteq) eph->compute_ddmdt_eq(sdmk->f_eq, true); // compute time derivative of density matrix in equilibrium
 			}
 			eph->evolve_driver(t, sdmk->dm, sdmk->oneminusdm, sdmk->ddmdt_term);
 			sdmk->update_ddmdt(sdmk->ddmdt_term);
@@ -289,15 +474,40 @@ public:
 	}
 	void update_scatt_outside(double t, int it){
 		bool update_eimp = update_eimp_model_outside(t, it), update_ee = update_ee_model_outside(it);
+		if (update_eimp || update_ee) save_dm_scatt(t, it);
+		update_scatt_models(update_eimp, update_ee, t);
+	}
+	void update_scatt_models(bool update_eimp, bool update_ee, double t, bool rebuild = false){
 		if (update_eimp){
 			sdmk->set_dm_eq(param->temperature, elec->e_dm, elec->nv_dm);
-			if (alg.ddmdteq && !alg.linearize_dPee) eph->reset_scatt(true, true, sdmk->dm_eq, nullptr, sdmk->t, sdmk->f_eq);
+			if (alg.ddmdteq && !alg.linearize_dPee) eph->reset_scatt(true, true, sdmk->dm_eq, nullptr, sdmk->t, sdmk->f_eq, rebuild);
 			if (alg.ddmdteq && !alg.linearize_dPee) eph->compute_ddmdt_eq(sdmk->f_eq); // compute time derivative of density matrix in equilibrium
 		}
 		sdmk->set_oneminusdm(); // also zeros(ddmdt)
-		eph->reset_scatt(update_eimp, update_ee, sdmk->dm, sdmk->oneminusdm, t, sdmk->f_eq);
+		eph->reset_scatt(update_eimp, update_ee, sdmk->dm, sdmk->oneminusdm, t, sdmk->f_eq, rebuild);
 		if (update_eimp && alg.linearize_dPee) eph->compute_ddmdt_eq(sdmk->f_eq); // compute time derivative of density matrix in equilibrium
 	}
+	// the scattering models depend on dm at their last update; restart needs that dm to continue with the same models
+	void save_dm_scatt(double t, int it){
+		if (dm_scatt == nullptr){
+			dm_scatt = alloc_array(sdmk->nk_glob, sdmk->nb*sdmk->nb);
+			ckpt_scatt = new dm_checkpoint(&mpk, sdmk->nk_glob, sdmk->nb, param->checkpoint_async, "denmat_scatt_restart");
+		}
+		std::copy(sdmk->dm[0], sdmk->dm[0] + (size_t)sdmk->nk_glob*sdmk->nb*sdmk->nb, dm_scatt[0]);
+		rs.it_scatt = it; rs.t_scatt = t;
+	}
+	void restore_scatt(){
+		int it = rs.it_scatt;
+		double t = rs.t_scatt;
+		save_dm_scatt(t, it);
+		ckpt_scatt->read(dm_scatt);
+		std::swap(sdmk->dm, dm_scatt);
+		// with alg.rescale_scatt, P of the continuous run may be rescaled from an earlier full rebuild, which is not saved;
+		// the restart rebuilds P at dm_scatt, so it agrees with the continuous run only within alg_rescale_scatt_tol_vq2/_dm
+		update_scatt_models(update_eimp_model_outside(t, it), update_ee_model_outside(it), t, true);
+		std::swap(sdmk->dm, dm_scatt);
+		sdmk->set_oneminusdm();
+	}
 	bool update_eimp_model_inside(double t){
 		bool update = pmp.active() && elight->during_laser(t) && param->freq_update_eimp_model < 0 && !alg.linearize;
 		if (!update) return false;
@@ -321,7 +531,6 @@ public:
 
 	void report(int it, bool diff = true, bool prtprobe = true, bool prtdos = false, string lable = ""){
 		if (it % ob->freq_measure != 0) return;
-		if (it > 0) sdmk->write_dm_tofile(sdmk->t);
 		bool print_ene = it % ob->freq_measure_ene == 0;
 		if (prtdos) ob->measure("dos", lable, true, true, sdmk->t, sdmk->dm); // for dos, diff == true just means file name has no "initial"
 		ob->measure("fn", lable, diff, print_ene, sdmk->t, sdmk->dm);
@@ -342,6 +551,7 @@ public:
 		ob->measure("entropy_bloch", lable, diff, false, sdmk->t, sdmk->dm);
 		ob->measure("entropy_vN", lable, diff, false, sdmk->t, sdmk->dm);
 		if (prtprobe && pmp.active()) elight->probe(it, sdmk->t, sdmk->dm, sdmk->oneminusdm);
+		if (ionode) obw.end_report();
 	}
 
 	void report_tau(int it, string lable = ""){
@@ -56,7 +56,8 @@ void electronlight::evolve_laser_coh(double t, complex** dm, complex** dm1, comp
 		}
 	}
 
-	mp->allreduce(ddmdt_laser, nk_glob, nb_dm*nb_dm, MPI_SUM);
+	if (alg.distribute_dm) mp->allgather(ddmdt_laser, nk_glob, nb_dm*nb_dm);
+	else mp->allreduce(ddmdt_laser, nk_glob, nb_dm*nb_dm, MPI_SUM);
 }
 void electronlight::evolve_laser_lindblad(double t, complex** dm, complex** dm1, complex** ddmdt_laser){
 	//double trel = t - pmp.pump_tcenter;
@@ -89,7 +90,8 @@ void electronlight::evolve_laser_lindblad(double t, complex** dm, complex** dm1,
 			ddmdt_laser[ik_glob][i*nb_dm + j] += prefac * (ddmdt_contrib[i*nb_dm + j] + conj(ddmdt_contrib[j*nb_dm + i]));
 	}
 
-	mp->allreduce(ddmdt_laser, nk_glob, nb_dm*nb_dm, MPI_SUM);
+	if (alg.distribute_dm) mp->allgather(ddmdt_laser, nk_glob, nb_dm*nb_dm);
+	else mp->allreduce(ddmdt_laser, nk_glob, nb_dm*nb_dm, MPI_SUM);
 }
 inline void electronlight::term_plus(complex *dm1, complex *a, complex *dm, complex *b){
 	// + (1-dm) * a * dm * b
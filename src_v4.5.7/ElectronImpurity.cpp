@@ -20,10 +20,8 @@ void electronimpurity::read_ldbd_imp_P(int ik, complex *P1, complex *P2){
 			if (sP1 != nullptr) delete sP1;
 			if (sP2 != nullptr) delete sP2;
 			string suffix = isHole ? alg.scatt + "_D" + int2str(iD+1) + "_hole" : alg.scatt + "_D" + int2str(iD+1);
-			sP1 = new sparse2D(mp, "ldbd_data/sP1_" + suffix + "_ns.bin", "ldbd_data/sP1_" + suffix + "_s.bin", "ldbd_data/sP1_" + suffix + "_i.bin", "ldbd_data/sP1_" + suffix + "_j.bin", nb*nb, nb*nb);
-			sP2 = new sparse2D(mp, "ldbd_data/sP2_" + suffix + "_ns.bin", "ldbd_data/sP2_" + suffix + "_s.bin", "ldbd_data/sP2_" + suffix + "_i.bin", "ldbd_data/sP2_" + suffix + "_j.bin", nb*nb, nb*nb);
-			sP1->read_smat(false); // do_test = false
-			sP2->read_smat(false);
+			sP1 = sparse2D::read_sparseP(mp, "ldbd_data/sP1_" + suffix, nb*nb, nb*nb);
+			sP2 = sparse2D::read_sparseP(mp, "ldbd_data/sP2_" + suffix, nb*nb, nb*nb);
 		}
 	}
 
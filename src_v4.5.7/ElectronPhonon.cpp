@@ -3,6 +3,8 @@
 void electronphonon::set_eph(){
 	alloc_ephmat(mp->varstart, mp->varend); // allocate matrix A or P
 	set_kpair();
+	if (coul_model != nullptr && alg.ovlp_precompute) coul_model->ovlps->precompute(mp, nkpair_proc, k1st, k2nd);
+	if (alg.distribute_dm) kh.init(&mpk, nk_glob, k1st, k2nd, nkpair_proc);
 	if (alg.linearize) return;
 	set_ephmat();
 	compute_imsig("eph");
@@ -11,11 +13,13 @@ void electronphonon::set_eph(){
 	//if (ee_model != nullptr && eep.eeMode == "Pee_fixed_at_eq" && !alg.only_eimp) { add_scatt_contrib("ee"); compute_imsig("eph_eimp_ee"); }
 	if (ee_model != nullptr && !alg.only_eimp) { add_scatt_contrib("ee"); compute_imsig("eph_eimp_ee"); } // to have ImSigma and mobility due to e-e, this should be always called
 	set_sparseP(true);
+	set_scatt_ref(nullptr);
 }
-void electronphonon::reset_scatt(bool reset_eimp, bool reset_ee, complex **dm_expand, complex **dm1_expand, double t, double **f_eq_expand){
+void electronphonon::reset_scatt(bool reset_eimp, bool reset_ee, complex **dm_expand, complex **dm1_expand, double t, double **f_eq_expand, bool rebuild){
 	// currently reset_eimp || reset_ee means resetting both e-i and e-e scatterings
 	// if you want to reset only one of them, you will need to modify the code to store another
 	if ((!reset_eimp && !reset_ee) || (eimp == nullptr && ee_model == nullptr)) return;
+	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 	trunc_copy_arraymat(dm, dm_expand, nk_glob, nb_expand, bStart, bEnd);
 	if (dm1_expand != nullptr)
 		trunc_copy_arraymat(dm1, dm1_expand, nk_glob, nb_expand, bStart, bEnd);
@@ -30,8 +34,16 @@ void electronphonon::reset_scatt(bool reset_eimp, bool reset_ee, complex **dm_ex
 		axbyc(f1_eq, f_eq, nk_glob, nb, -1, 0, 1);
 	}
 
-	set_ephmat();
 	if (coul_model != nullptr && clp.update) coul_model->init(dm);
+	if (!rebuild && rescale_scatt_valid() && rescale_scatt()){
+		set_sparseP(false);
+		auto duration = duration_cast<microseconds>(high_resolution_clock::now() - t1).count();
+		if (ionode) printf("reset_scatt: e-i and e-e P rescaled by |vq_new / vq_old|^2 in %.3lf s\n", duration / 1.0e6);
+		return;
+	}
+
+	set_ephmat();
+	if (P1sc != nullptr) { zeros(P1sc, nkpair_proc, (int)std::pow(nb, 4)); zeros(P2sc, nkpair_proc, (int)std::pow(nb, 4)); }
 	for (int iD = 0; iD < eip.ni.size(); iD++)
 		if (!alg.only_ee){ 
 			if (eimp[iD]->eimp_model != nullptr && eimp[iD]->eimp_model->imsig != nullptr) zeros(eimp[iD]->eimp_model->imsig, nk_glob, nb); 
@@ -39,6 +51,75 @@ void electronphonon::reset_scatt(bool reset_eimp, bool reset_ee, complex **dm_ex
 		}
 	if (ee_model != nullptr && !alg.only_eimp) { if (ee_model->imsig != nullptr) zeros(ee_model->imsig, nk_glob, nb); add_scatt_contrib("ee", 0, dm, dm1, t); }
 	set_sparseP(false);
+	set_scatt_ref(dm);
+	auto duration = duration_cast<microseconds>(high_resolution_clock::now() - t1).count();
+	if (ionode) printf("reset_scatt: e-i and e-e P rebuilt in %.3lf s\n", duration / 1.0e6);
+}
+
+// with static screening, the e-i P of a k pair (k,k') is proportional to |vq(k-k')|^2 and so is the e-e P without the exchange term,
+// as all its terms have the same q = k-k'; other contributions (ab_neutral e-i, exchange) are not, and need the full rebuild
+bool electronphonon::rescale_scatt_valid(){
+	if (!alg.rescale_scatt || coul_model == nullptr || clp.dynamic != "static" || alg.only_eimp || alg.only_ee) return false;
+	if (ee_model != nullptr && eep.antisymmetry) return false;
+	for (int iD = 0; iD < eip.ni.size(); iD++)
+		if (eimp[iD]->eimp_model == nullptr) return false;
+	return true;
+}
+void electronphonon::set_scatt_ref(complex **dm){
+	if (!rescale_scatt_valid()) return;
+	vq2_full.resize(nkpair_proc);
+	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++)
+		vq2_full[ikpair_local] = coul_model->vq(elec->kvec[k1st[ikpair_local]] - elec->kvec[k2nd[ikpair_local]]).norm();
+	vq2_scatt = vq2_full;
+	if (ee_model == nullptr) return;
+	if (dm_scatt_ref == nullptr) dm_scatt_ref = alloc_array(nk_glob, nb*nb);
+	if (dm != nullptr) { axbyc(dm_scatt_ref, dm, nk_glob, nb*nb); return; }
+	zeros(dm_scatt_ref, nk_glob, nb*nb);
+	for (int ik = 0; ik < nk_glob; ik++)
+	for (int b = 0; b < nb; b++)
+		dm_scatt_ref[ik][b*nb + b] = ee_model->f[ik][b];
+}
+// e-e P also depends on the density matrix (occupations and coherences), which is only taken into account by a full rebuild;
+// so the absolute change of dm elements since the last full rebuild is limited by alg.rescale_scatt_tol_dm
+bool electronphonon::rescale_scatt(){
+	vector<double> vq2(nkpair_proc);
+	double dvq2 = 0, ddm = 0;
+	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
+		vq2[ikpair_local] = coul_model->vq(elec->kvec[k1st[ikpair_local]] - elec->kvec[k2nd[ikpair_local]]).norm();
+		if (vq2_full[ikpair_local] > 0) dvq2 = std::max(dvq2, fabs(vq2[ikpair_local] / vq2_full[ikpair_local] - 1));
+	}
+	if (ee_model != nullptr)
+		for (int ik = 0; ik < nk_glob; ik++)
+		for (int i = 0; i < nb*nb; i++)
+			ddm = std::max(ddm, abs(dm[ik][i] - dm_scatt_ref[ik][i]));
+	mp->allreduce(dvq2, MPI_MAX); mp->allreduce(ddm, MPI_MAX);
+	if (ionode) printf("reset_scatt: since the last full rebuild, max relative change of |vq|^2 = %10.3le, max change of dm = %10.3le\n", dvq2, ddm);
+	if (dvq2 > alg.rescale_scatt_tol_vq2 || ddm > alg.rescale_scatt_tol_dm) return false;
+
+	int Psize = (int)std::pow(nb, 4);
+	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
+		double fac = vq2_scatt[ikpair_local] > 0 ? vq2[ikpair_local] / vq2_scatt[ikpair_local] : 1;
+		vq2_scatt[ikpair_local] = vq2[ikpair_local];
+		if (fac == 1) continue;
+		if (!alg.Pin_is_sparse){
+			axbyc(P1[ikpair_local], P1sc[ikpair_local], Psize, complex(fac - 1, 0), c1); // P += (fac - 1) Psc
+			axbyc(P2[ikpair_local], P2sc[ikpair_local], Psize, complex(fac - 1, 0), c1);
+			axbyc(P1sc[ikpair_local], nullptr, Psize, c0, complex(fac, 0));
+			axbyc(P2sc[ikpair_local], nullptr, Psize, c0, complex(fac, 0));
+		}
+		else{
+			sparse_mat *smat1 = sP1->smat[ikpair_local], *smat2 = sP2->smat[ikpair_local];
+			for (int is = 0; is < smat1->ns; is++)
+				smat1->s[is] = sP1_eph[ikpair_local][is] + fac * (smat1->s[is] - sP1_eph[ikpair_local][is]);
+			for (int is = 0; is < smat2->ns; is++)
+				smat2->s[is] = sP2_eph[ikpair_local][is] + fac * (smat2->s[is] - sP2_eph[ikpair_local][is]);
+		}
+		if (alg.linearize_dPee){
+			axbyc(dP1ee[ikpair_local], nullptr, Psize, c0, complex(fac, 0));
+			axbyc(dP2ee[ikpair_local], nullptr, Psize, c0, complex(fac, 0));
+		}
+	}
+	return true;
 }
 
 void electronphonon::add_scatt_contrib(string what, int iD, complex **dm, complex **dm1, double t){
@@ -89,12 +170,14 @@ void electronphonon::add_scatt_contrib(string what, int iD, complex **dm, comple
 
 		complex factor = ((what == "eimp" && iD == 0 && alg.only_eimp) || (what == "ee" && alg.only_ee)) ? c0 : c1;
 		if (alg.Pin_is_sparse){
-			sparse_plus_dense(sP1->smat[ikpair_local], alg.thr_sparseP, P1add, nb*nb, nb*nb, c1, factor);
-			sparse_plus_dense(sP2->smat[ikpair_local], alg.thr_sparseP, P2add, nb*nb, nb*nb, c1, factor);
+			add_sparseP(sP1, sP1_eph, ikpair_local, P1add, factor);
+			add_sparseP(sP2, sP2_eph, ikpair_local, P2add, factor);
 		}
 		else{
 			axbyc(P1[ikpair_local], P1add, (int)std::pow(nb, 4), c1, factor);
 			axbyc(P2[ikpair_local], P2add, (int)std::pow(nb, 4), c1, factor);
+			if (P1sc != nullptr) axbyc(P1sc[ikpair_local], P1add, (int)std::pow(nb, 4), c1, c1);
+			if (P1sc != nullptr) axbyc(P2sc[ikpair_local], P2add, (int)std::pow(nb, 4), c1, c1);
 		}
 		if (ldebug){
 			fprintf_complex_mat(fp, P1add, nb*nb, "P1add:"); fflush(fp);
@@ -109,9 +192,37 @@ void electronphonon::add_scatt_contrib(string what, int iD, complex **dm, comple
 
 	if (what == "eimp" && eip.impMode[iD] == "model_ionized") eimp[iD]->eimp_model->reduce_imsig(this->mp);
 	if (what == "ee") ee_model->reduce_imsig(this->mp);
+	if (coul_model != nullptr && (what == "ee" || eip.impMode[iD] == "model_ionized")) coul_model->ovlps->report(mp, what);
 	if (ldebug) fclose(fp);
 }
 
+void electronphonon::add_sparseP(sparse2D *sP, complex **sP_eph, int ikpair_local, complex *Padd, complex factor){
+	sparse_mat *smat = sP->smat[ikpair_local];
+	// usually the contribution lies on the union pattern, which is built by the first update
+	if (sparse_plus_dense_fixed(smat, alg.thr_sparseP, Padd, nb*nb, nb*nb, c1, factor)) return;
+	int ns_old = smat->ns;
+	int *pos = new int[ns_old];
+	sparse_union_plus_dense(smat, alg.thr_sparseP, Padd, nb*nb, nb*nb, c1, factor, pos);
+	complex *eph = new complex[smat->ns]{c0};
+	for (int is = 0; is < ns_old; is++)
+		eph[pos[is]] = sP_eph[ikpair_local][is];
+	delete[] sP_eph[ikpair_local]; sP_eph[ikpair_local] = eph;
+	delete[] pos;
+}
+void electronphonon::save_sparseP_eph(sparse2D *sP, complex **&sP_eph){
+	if (sP_eph != nullptr){
+		for (size_t ik = 0; ik < sP->nk; ik++) delete[] sP_eph[ik];
+		delete[] sP_eph;
+	}
+	sP_eph = new complex*[sP->nk];
+	for (size_t ik = 0; ik < sP->nk; ik++){
+		sparse_mat *smat = sP->smat[ik];
+		if (smat->rowptr == nullptr) smat->build_csr(sP->ni);
+		sP_eph[ik] = new complex[smat->ns];
+		std::copy(smat->s, smat->s + smat->ns, sP_eph[ik]);
+	}
+}
+
 void electronphonon::set_sparseP(bool fisrt_call){
 	if (alg.Pin_is_sparse) return;
 	if (!alg.sparseP && !fisrt_call) return;
@@ -124,8 +235,8 @@ void electronphonon::set_sparseP(bool fisrt_call){
 		sP1->sparse(P1, false); // do_test = false
 		sP2->sparse(P2, false);
 		string suffix = isHole ? alg.scatt + "_hole" : alg.scatt;
-		sP1->write_smat("ldbd_data/sP1_" + suffix + "_ns.bin", "ldbd_data/sP1_" + suffix + "_s.bin", "ldbd_data/sP1_" + alg.scatt + "_i.bin", "ldbd_data/sP1_" + alg.scatt + "_j.bin");
-		sP2->write_smat("ldbd_data/sP2_" + suffix + "_ns.bin", "ldbd_data/sP2_" + suffix + "_s.bin", "ldbd_data/sP2_" + alg.scatt + "_i.bin", "ldbd_data/sP2_" + alg.scatt + "_j.bin");
+		sP1->write_container("ldbd_data/sP1_" + suffix + ".bin");
+		sP2->write_container("ldbd_data/sP2_" + suffix + ".bin");
 	}
 }
 
@@ -175,32 +286,45 @@ void electronphonon::get_nkpair(){
 	}
 	fclose(fp);
 }
+// with sparse P, the cost of a k pair is about the number of elements of its sparse P matrices, which can differ by orders of magnitude
+// (e.g. intra- and intervalley pairs); they are read from the index of the sparse P files, plus nb^3 for the dense work of each pair
+bool electronphonon::get_kpair_weights(vector<double>& weight){
+	if (!alg.Pin_is_sparse && !alg.sparseP) return false;
+	weight.assign(nkpair_glob, std::pow(nb, 3));
+	int nfile = 0;
+	if (ionode){
+		string suffix_eh = isHole ? "_hole" : "";
+		vector<string> suffixes;
+		if (alg.eph_enable) suffixes.push_back(alg.scatt + suffix_eh);
+		for (int iD = 0; iD < eip.ni.size(); iD++) suffixes.push_back(alg.scatt + "_D" + int2str(iD + 1) + suffix_eh);
+		for (string suffix : suffixes){
+			if (sparse2D::add_ns_kpair("ldbd_data/sP1_" + suffix, weight)) nfile++;
+			if (sparse2D::add_ns_kpair("ldbd_data/sP2_" + suffix, weight)) nfile++;
+		}
+	}
+	MPI_Bcast(&nfile, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	if (nfile == 0) return false;
+	MPI_Bcast(weight.data(), nkpair_glob, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	return true;
+}
 void electronphonon::set_kpair(){
 	if (code == "jdftx")
 		read_ldbd_kpair();
 }
 void electronphonon::read_ldbd_kpair(){
 	if (ionode) printf("\nread ldbd_kpair_k1st(2nd)(_hole).bin:\n");
-	FILE *fpk, *fpkp;
-	if (!isHole){
-		fpk = fopen("ldbd_data/ldbd_kpair_k1st.bin", "rb");
-		fpkp = fopen("ldbd_data/ldbd_kpair_k2nd.bin", "rb");
-	}
-	else{
-		fpk = fopen("ldbd_data/ldbd_kpair_k1st_hole.bin", "rb");
-		fpkp = fopen("ldbd_data/ldbd_kpair_k2nd_hole.bin", "rb");
-	}
+	string suffix = isHole ? "_hole" : "";
+	ldbd_file fpk("ldbd_data/ldbd_kpair_k1st" + suffix + ".bin", false), fpkp("ldbd_data/ldbd_kpair_k2nd" + suffix + ".bin", false);
 	size_t expected_size = nkpair_glob*sizeof(size_t);
-	check_file_size(fpk, expected_size, "ldbd_kpair_k1st(_hole).bin size does not match expected size");
-	check_file_size(fpkp, expected_size, "ldbd_kpair_k2nd(_hole).bin size does not match expected size");
+	fpk.check_size(expected_size, "ldbd_kpair_k1st(_hole).bin size does not match expected size");
+	fpkp.check_size(expected_size, "ldbd_kpair_k2nd(_hole).bin size does not match expected size");
 
-	int pos = ikpair0_glob * sizeof(size_t);
-	fseek(fpk, pos, SEEK_SET);
-	fseek(fpkp, pos, SEEK_SET);
+	fpk.seek(ikpair0_glob, sizeof(size_t));
+	fpkp.seek(ikpair0_glob, sizeof(size_t));
 
-	fread(k1st, sizeof(size_t), nkpair_proc, fpk);
-	fread(k2nd, sizeof(size_t), nkpair_proc, fpkp);
-	fclose(fpk); fclose(fpkp);
+	fpk.read(k1st, sizeof(size_t), nkpair_proc);
+	fpkp.read(k2nd, sizeof(size_t), nkpair_proc);
+	fpk.close(); fpkp.close();
 }
 
 void electronphonon::set_ephmat(){
@@ -218,19 +342,26 @@ void electronphonon::read_ldbd_eph(){
 		size_t Psize = (size_t)std::pow(nb, 4);
 		size_t expected_size = nkpair_glob*Psize * 2 * sizeof(double);
 
-		FILE *fp1 = fopen(fname1.c_str(), "rb");
-		check_file_size(fp1, expected_size, fname1 + " size does not match expected size");
-		fseek_bigfile(fp1, ikpair0_glob, Psize * 2 * sizeof(double));
-		fread(P1[0], 2 * sizeof(double), nkpair_proc * Psize, fp1);
+		ldbd_file fp1(fname1, false); // each process reads its own k pairs
+		fp1.check_size(expected_size, fname1 + " size does not match expected size");
+		fp1.seek(ikpair0_glob, Psize * 2 * sizeof(double));
+		fp1.read(P1[0], 2 * sizeof(double), nkpair_proc * Psize);
 		if (scale_eph != 1.) axbyc(P1, nullptr, nkpair_proc, Psize, c0, complex(scale_eph, 0));
-		fclose(fp1);
+		fp1.close();
 
-		FILE *fp2 = fopen(fname2.c_str(), "rb");
-		check_file_size(fp2, expected_size, fname1 + " size does not match expected size");
-		fseek_bigfile(fp2, ikpair0_glob, Psize * 2 * sizeof(double));
-		fread(P2[0], 2 * sizeof(double), nkpair_proc * Psize, fp2);
+		ldbd_file fp2(fname2, false);
+		fp2.check_size(expected_size, fname1 + " size does not match expected size");
+		fp2.seek(ikpair0_glob, Psize * 2 * sizeof(double));
+		fp2.read(P2[0], 2 * sizeof(double), nkpair_proc * Psize);
 		if (scale_eph != 1.) axbyc(P2, nullptr, nkpair_proc, Psize, c0, complex(scale_eph, 0));
-		fclose(fp2);
+		fp2.close();
+	}
+	else if (sP1 != nullptr && sP1_eph != nullptr){
+		// keep the union pattern of the scattering contributions and only reset the values, instead of reading the files again
+		for (size_t ik = 0; ik < sP1->nk; ik++){
+			std::copy(sP1_eph[ik], sP1_eph[ik] + sP1->smat[ik]->ns, sP1->smat[ik]->s);
+			std::copy(sP2_eph[ik], sP2_eph[ik] + sP2->smat[ik]->ns, sP2->smat[ik]->s);
+		}
 	}
 	else{
 		if (ionode) printf("Read sP1 and sP2\n");
@@ -238,10 +369,8 @@ void electronphonon::read_ldbd_eph(){
 		if (sP2 != nullptr) { delete sP2; sP2 = nullptr; }
 		if (alg.eph_enable){
 			string suffix = isHole ? alg.scatt + "_hole" : alg.scatt;
-			sP1 = new sparse2D(mp, "ldbd_data/sP1_" + suffix + "_ns.bin", "ldbd_data/sP1_" + suffix + "_s.bin", "ldbd_data/sP1_" + suffix + "_i.bin", "ldbd_data/sP1_" + suffix + "_j.bin", nb*nb, nb*nb);
-			sP2 = new sparse2D(mp, "ldbd_data/sP2_" + suffix + "_ns.bin", "ldbd_data/sP2_" + suffix + "_s.bin", "ldbd_data/sP2_" + suffix + "_i.bin", "ldbd_data/sP2_" + suffix + "_j.bin", nb*nb, nb*nb);
-			sP1->read_smat(false); // do_test = false
-			sP2->read_smat(false);
+			sP1 = sparse2D::read_sparseP(mp, "ldbd_data/sP1_" + suffix, nb*nb, nb*nb);
+			sP2 = sparse2D::read_sparseP(mp, "ldbd_data/sP2_" + suffix, nb*nb, nb*nb);
 			sparse_plus_dense(sP1->smat, sP1->thrsh, nullptr, sP1->nk, sP1->ni, sP1->nj, c0, complex(scale_eph, 0));
 			sparse_plus_dense(sP2->smat, sP2->thrsh, nullptr, sP2->nk, sP2->ni, sP2->nj, c0, complex(scale_eph, 0));
 		}
@@ -249,6 +378,8 @@ void electronphonon::read_ldbd_eph(){
 			sP1 = new sparse2D(mp, nullptr, nb*nb, nb*nb, alg.thr_sparseP);
 			sP2 = new sparse2D(mp, nullptr, nb*nb, nb*nb, alg.thr_sparseP);
 		}
+		save_sparseP_eph(sP1, sP1_eph);
+		save_sparseP_eph(sP2, sP2_eph);
 	}
 }
 
@@ -260,21 +391,22 @@ void electronphonon::alloc_ephmat(int ikpair0, int ikpair1){
 		if (!alg.linearize){
 			if (!alg.Pin_is_sparse) P1 = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
 			if (!alg.Pin_is_sparse) P2 = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
-			if (!alg.Pin_is_sparse && !alg.sparseP) P1_next = new complex[(int)std::pow(nb, 4)]{c0};
-			if (!alg.Pin_is_sparse && !alg.sparseP) P2_next = new complex[(int)std::pow(nb, 4)]{c0};
 			if (alg.linearize_dPee) dP1ee = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
 			if (alg.linearize_dPee) dP2ee = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
+			if (!alg.Pin_is_sparse && rescale_scatt_valid()) P1sc = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
+			if (!alg.Pin_is_sparse && rescale_scatt_valid()) P2sc = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
 		}
 		else{
 			Lscii = alloc_array(nk_glob, (int)std::pow(nb, 4));
-			Lscij = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
-			Lscji = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
-			Lsct = new complex[(int)std::pow(nb, 4)]{c0};
+			if (alg.Pin_is_sparse || alg.sparseP){ // built k pair by k pair, see add_sLsc
+				sLscij = new sparse2D(mp, nullptr, nb*nb, nb*nb, alg.thr_sparseP);
+				sLscji = new sparse2D(mp, nullptr, nb*nb, nb*nb, alg.thr_sparseP);
+			}
+			else{
+				Lscij = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
+				Lscji = alloc_array(nkpair_proc, (int)std::pow(nb, 4));
+			}
 		}
-		//if (alg.expt)
-		P1t = new complex[(int)std::pow(nb, 4)]{c0};
-		//if (!alg.linearize && alg.expt)
-		P2t = new complex[(int)std::pow(nb, 4)]{c0};
 	}
 	else{
 		if (alg.scatt == "lindblad"){
@@ -291,16 +423,53 @@ void electronphonon::alloc_ephmat(int ikpair0, int ikpair1){
 	dm1 = alloc_array(nk_glob, nb*nb);
 	ddmdt_eph = alloc_array(nk_glob, nb*nb);
 
-	if (alg.Pin_is_sparse || alg.sparseP){
-		if (!alg.linearize) sm1_next = new sparse_mat((int)std::pow(nb, 4), true);
-		if (!alg.linearize) sm2_next = new sparse_mat((int)std::pow(nb, 4), true);
-		//if (alg.expt){
-		smat1_time = new sparse_mat((int)std::pow(nb, 4), true);
-		//if (!alg.linearize)
-		smat2_time = new sparse_mat((int)std::pow(nb, 4), true);
-		make_map();
-		//}
+	if (alg.Pin_is_sparse || alg.sparseP) make_map();
+	alloc_kpair_work();
+}
+
+void electronphonon::alloc_kpair_work(){
+	nthreads = nthreads_omp();
+	kpair_block = 32 * nthreads;
+	int nb4 = (int)std::pow(nb, 4);
+	work = new kpair_work[nthreads];
+	for (int ith = 0; ith < nthreads; ith++){
+		kpair_work& w = work[ith];
+		w.P1t = nullptr; w.P2t = nullptr; w.P1_next = nullptr; w.P2_next = nullptr;
+		w.smat1_time = nullptr; w.smat2_time = nullptr; w.sm1_next = nullptr; w.sm2_next = nullptr;
+		w.phase_row = new complex[nb*nb]{c0};
+		w.phase_col = new complex[nb*nb]{c0};
+		w.contrib = new complex[nb*nb]{c0};
+		if (!alg.summode) continue;
+		w.P1t = new complex[nb4]{c0};
+		w.P2t = new complex[nb4]{c0};
+		if (!alg.linearize && !alg.Pin_is_sparse && !alg.sparseP){
+			w.P1_next = new complex[nb4]{c0};
+			w.P2_next = new complex[nb4]{c0};
+		}
+		if (alg.Pin_is_sparse || alg.sparseP){
+			w.smat1_time = new sparse_mat(nb4, true);
+			w.smat2_time = new sparse_mat(nb4, true);
+			if (!alg.linearize) w.sm1_next = new sparse_mat(nb4, true);
+			if (!alg.linearize) w.sm2_next = new sparse_mat(nb4, true);
+		}
+	}
+	kpair_contrib = alloc_array(kpair_block, 8, nb*nb);
+	kpair_active = new bool[kpair_block]{false};
+	if (ionode) printf("k-pair loops use %d threads per process\n", nthreads);
+}
+
+void electronphonon::free_kpair_work(){
+	if (work == nullptr) return;
+	for (int ith = 0; ith < nthreads; ith++){
+		kpair_work& w = work[ith];
+		delete[] w.P1t; delete[] w.P2t; delete[] w.P1_next; delete[] w.P2_next;
+		delete[] w.phase_row; delete[] w.phase_col; delete[] w.contrib;
+		delete w.smat1_time; delete w.smat2_time; delete w.sm1_next; delete w.sm2_next;
 	}
+	delete[] work; work = nullptr;
+	for (int i = 0; i < kpair_block; i++)
+		dealloc_array(kpair_contrib[i]);
+	delete[] kpair_contrib; delete[] kpair_active;
 }
 
 void electronphonon::make_map(){
@@ -7,6 +7,8 @@
 #include "ElectronImpurity.h"
 #include "ElecImp_Model.h"
 #include "ElecElec_Model.h"
+#include "khalo.h"
+#include "workspace.h"
 
 // e-ph here also contains e-i and e-e, so in future we need to reorganise the source codes related to the scattering
 
@@ -31,36 +33,47 @@ public:
 	size_t *k1st, *k2nd; // use size_t to be consistent with jdftx
 	int nm, nb, nv, nc;
 	complex ***App, ***Amm, ***Apm, ***Amp; // App=Gp*sqrt(nq+1), Amm=Gm*sqrt(nq), Apm=Gp*sqrt(nq), Amp=Gm*sqrt(nq+1)
-	complex **P1, **P2, *P1_next, *P2_next, **dP1ee, **dP2ee;
+	complex **P1, **P2, **dP1ee, **dP2ee;
 	sparse2D *sP1, *sP2;
-	sparse_mat *sm1_next, *sm2_next;
+	// if alg.Pin_is_sparse: the pattern of sP1 and sP2 of each k pair is the union of all scattering contributions added so far,
+	// kept when the scattering is reset; sP1_eph and sP2_eph are the values of the (scaled) e-ph part on this pattern
+	complex **sP1_eph, **sP2_eph;
+	// if alg.rescale_scatt: P1sc and P2sc are the e-i and e-e parts of P1 and P2 (if !alg.Pin_is_sparse, otherwise sP - sP_eph),
+	// vq2_scatt and vq2_full are |vq(k-k')|^2 of the local k pairs in P now and at the last full rebuild,
+	// dm_scatt_ref is the density matrix at the last full rebuild (if e-e)
+	complex **P1sc, **P2sc;
+	vector<double> vq2_scatt, vq2_full;
+	complex **dm_scatt_ref;
 	int *ij2i, *ij2j;
+	khalo kh; // halo k points of local k pairs, used if alg.distribute_dm
 
 	electronphonon(parameters *param, bool sepr_eh = false, bool isHole = false)
-		:sepr_eh(false), isHole(false), degauss(param->degauss), prefac_gaussexp(-0.5 / std::pow(param->degauss, 2)),
+		:sepr_eh(false), isHole(false), t0(param->t0), tend(param->tend), degauss(param->degauss), prefac_gaussexp(-0.5 / std::pow(param->degauss, 2)),
 		prefac_sqrtgaussexp(-0.25 / std::pow(param->degauss, 2)),
 		prefac_gauss(1. / (sqrt(2 * M_PI) * param->degauss)), prefac_sqrtgauss(1. / sqrt(sqrt(2 * M_PI) * param->degauss)),
 		scale_scatt(param->scale_scatt), scale_eph(param->scale_eph), scale_ei(param->scale_ei), scale_ee(param->scale_ee),
-		t0(param->t0), tend(param->tend)
+		work(nullptr)
 	{}
 	electronphonon(lattice *latt, parameters *param, bool sepr_eh = false, bool isHole = false)
-		:latt(latt), sepr_eh(false), isHole(false), degauss(param->degauss), prefac_gaussexp(-0.5 / std::pow(param->degauss, 2)),
+		:sepr_eh(false), isHole(false), latt(latt), t0(param->t0), tend(param->tend), degauss(param->degauss), prefac_gaussexp(-0.5 / std::pow(param->degauss, 2)),
 		prefac_sqrtgaussexp(-0.25 / std::pow(param->degauss, 2)),
 		prefac_gauss(1. / (sqrt(2 * M_PI) * param->degauss)), prefac_sqrtgauss(1. / sqrt(sqrt(2 * M_PI) * param->degauss)),
 		scale_scatt(param->scale_scatt), scale_eph(param->scale_eph), scale_ei(param->scale_ei), scale_ee(param->scale_ee),
-		t0(param->t0), tend(param->tend)
+		work(nullptr)
 	{}
 	electronphonon(mymp *mp, lattice *latt, parameters *param, electron *elec, phonon *ph, bool sepr_eh = false, bool isHole = false)
-		:mp(mp), latt(latt), sepr_eh(sepr_eh), isHole(isHole), elec(elec), nk_glob(elec->nk), ph(ph), nm(ph->nm),
+		:mp(mp), sepr_eh(sepr_eh), isHole(isHole), latt(latt), elec(elec), ph(ph),
+		coul_model(nullptr), eimp(nullptr), ee_model(nullptr),
+		t0(param->t0), tend(param->tend),
 		degauss(param->degauss), prefac_gaussexp(-0.5 / std::pow(param->degauss, 2)),
 		prefac_sqrtgaussexp(-0.25 / std::pow(param->degauss, 2)),
 		prefac_gauss(1. / (sqrt(2 * M_PI) * param->degauss)), prefac_sqrtgauss(1. / sqrt(sqrt(2 * M_PI) * param->degauss)),
+		prefac_eph(2 * M_PI / elec->nk_full),
 		scale_scatt(param->scale_scatt), scale_eph(param->scale_eph), scale_ei(param->scale_ei), scale_ee(param->scale_ee),
-		t0(param->t0), tend(param->tend),
+		nk_glob(elec->nk), nm(ph->nm),
+		dP1ee(nullptr), dP2ee(nullptr), sP1(nullptr), sP2(nullptr), sP1_eph(nullptr), sP2_eph(nullptr), P1sc(nullptr), P2sc(nullptr), dm_scatt_ref(nullptr),
 		need_imsig(param->need_imsig),
-		prefac_eph(2 * M_PI / elec->nk_full),
-		coul_model(nullptr), eimp(nullptr), f_eq(nullptr), ee_model(nullptr), sP1(nullptr), sP2(nullptr),
-		dP1ee(nullptr), dP2ee(nullptr)
+		f_eq(nullptr), sLscij(nullptr), sLscji(nullptr), work(nullptr), ws(nullptr), expe(nullptr)
 	{
 		if (ionode) printf("\n");
 		if (ionode) printf("==================================================\n");
@@ -91,6 +104,7 @@ public:
 		if (eep.eeMode != "none" && alg.summode)
 			ee_model = new elecelec_model(latt, param, elec, bStart, bEnd, eStart, eEnd, coul_model);
 	}
+	~electronphonon(){ free_kpair_work(); }
 
 	inline double gauss_exp(double e){
 		return exp(prefac_gaussexp * std::pow(e, 2));
@@ -112,6 +126,7 @@ public:
 	void set_eph();
 	void get_brange(bool sepr_eh, bool isHole);
 	void get_nkpair();
+	bool get_kpair_weights(vector<double>& weight); // estimated cost of each k pair for distribute_var; false if not known
 	void alloc_ephmat(int, int);
 	void set_kpair();
 	void read_ldbd_kpair();
@@ -120,8 +135,13 @@ public:
 	void make_map();
 	void set_sparseP(bool fisrt_call);
 	void add_scatt_contrib(string what, int iD=0, complex **dm = nullptr, complex **dm1 = nullptr, double t = 0);
+	void add_sparseP(sparse2D *sP, complex **sP_eph, int ikpair_local, complex *Padd, complex factor); // sP = Padd + factor * sP
+	void save_sparseP_eph(sparse2D *sP, complex **&sP_eph);
 	//void reset_scatt(bool reset_eimp, bool reset_ee, double nfree, complex **dm, complex **dm1, double t);
-	void reset_scatt(bool reset_eimp, bool reset_ee, complex **dm, complex **dm1, double t, double **f_eq_expand = nullptr);
+	void reset_scatt(bool reset_eimp, bool reset_ee, complex **dm, complex **dm1, double t, double **f_eq_expand = nullptr, bool rebuild = false); // rebuild: never rescale
+	bool rescale_scatt_valid();
+	void set_scatt_ref(complex **dm); // after a full rebuild of the e-i and e-e parts; dm = nullptr for the equilibrium f of ee_model
+	bool rescale_scatt(); // instead of a full rebuild; false if the change since the last full rebuild exceeds alg.rescale_scatt_tol_vq2 or _dm
 
 	// Analysis
 	bool need_imsig;
@@ -136,33 +156,97 @@ public:
 
 	// Linearize the scattering term of the density-matrix master equation
 	double **f_eq, **f1_eq; // f1_eq = 1 - f_eq
-	complex **Lscij, **Lscji, *Lsct, **Lscii; // Linear operator of the scattering term of master equation. "ij" for ki <= kj; "ji" for kj <= ki;
+	complex **Lscij, **Lscji, **Lscii; // Linear operator of the scattering term of master equation. "ij" for ki <= kj; "ji" for kj <= ki;
 		// ii for parts: - \sum_3 [ (1-f3) conj(P_331a) delta_2b + delta_1a P_b233 f3 ] where k1=k2=ka=kb
-	sparse2D *sLscij, *sLscji;
+	sparse2D *sLscij, *sLscji; // used instead of Lscij and Lscji if alg.Pin_is_sparse or alg.sparseP, nullptr otherwise
 	void set_Lsc(double **f_eq);
 	void set_Leph_from_jdftx_data();
 	void add_Lsc_contrib(string what, int iD=0);
 	void add_Lscii_from_P1_P2(complex *P1, complex *P2, int ik, int jk);
-	void add_Lscij_from_P1_P2(complex *P1, complex *P2, int ikpair_local, int ik, int jk, bool fac2 = false);
-	void add_Lscij_from_P3_P4(complex *P3, complex *P4, int ikpair_local, int ik, int jk);
-	void add_Lscij_from_P5_P6(complex *P5, complex *P6, int ikpair_local, int ik, int jk);
+	// Lscij and Lscji: rows of one k pair
+	void add_Lscij_from_P1_P2(complex *P1, complex *P2, complex *Lscij, complex *Lscji, int ik, int jk, bool fac2 = false);
+	void add_Lscij_from_P3_P4(complex *P3, complex *P4, complex *Lscij, complex *Lscji, int ik, int jk);
+	void add_Lscij_from_P5_P6(complex *P5, complex *P6, complex *Lscij, complex *Lscji, int ik, int jk);
+	void add_sLsc(int ikpair_local, complex *lij, complex *lji);
 
 	// evolve
 	complex **ddmdt_eq;
-	complex *ddmdt_contrib, *maux1, *maux2, *P1t, *P2t;
-	sparse_mat *smat1_time, *smat2_time;
+	complex *ddmdt_contrib, *maux1, *maux2;
 	double **e;
+
+	// scratch of one OpenMP thread in the k-pair loops
+	struct kpair_work{
+		complex *P1t, *P2t, *P1_next, *P2_next, *phase_row, *phase_col, *contrib;
+		sparse_mat *smat1_time, *smat2_time, *sm1_next, *sm2_next;
+	};
+	int nthreads, kpair_block;
+	kpair_work *work;
+	// contributions of the k pairs of one block, added to Pdm, dm1P, ... in k-pair order after the threaded loop
+	complex ***kpair_contrib;
+	bool *kpair_active;
+	void alloc_kpair_work();
+	void free_kpair_work();
 	complex **dm, **dm1, **ddmdt_eph;
+	// scratch arrays of evolve, evolve_linear and compute_ddmdt_eq; owned by dm_dynamics
+	workspace *ws;
+	std::vector<MPI_Request> reqs;
+	void reserve_workspace();
 
-	void compute_ddmdt_eq(double **f0_expand);
+	void compute_ddmdt_eq(double **f0_expand, bool keep_buffers = false); // keep_buffers if called in every right-hand side
 	void evolve_driver(double t, complex **dm_expand, complex **dm1_expand, complex **ddmdt_expand, bool compute_eq = false);
 	void evolve(double t, complex **dm, complex **dm1, complex **ddmdt, bool compute_eq = false);
 
 	// linearization
 	void evolve_linear(double t, complex **dm, complex **ddmdt);
-	void compute_ddmdt(complex *dmkp, complex *lsc, complex *ddmdtk);
-
-	inline void compute_Pt(double t, double *ek, double *ekp, complex *P, complex *Pt, bool minus);
+	void compute_ddmdt(complex *dmkp, complex *lsc, complex *ddmdtk, complex *contrib);
+	void compute_ddmdt(complex *dmkp, sparse_mat *lsc, complex *ddmdtk, complex *contrib);
+
+	// interaction-picture phases factorize into per-k band factors expe[ik][i] = exp(i*e^k_i*t), updated once per t
+	complex **expe;
+	double t_expe;
+	void set_expe(double t);
+	inline void set_phase_rowcol(complex *phk, complex *phkp, bool minus, kpair_work& w);
+	inline void compute_Pt(complex *phk, complex *phkp, complex *P, complex *Pt, bool minus, kpair_work& w);
 	inline void init_sparse_mat(sparse_mat *sin, sparse_mat *sout, bool copy_elem = false);
-	inline void compute_sPt(double t, double *ek, double *ekp, sparse_mat *sm, sparse_mat *smt, bool minus);
-};
\ No newline at end of file
+	inline void compute_sPt(complex *phk, complex *phkp, sparse_mat *sm, sparse_mat *smt, bool minus, kpair_work& w);
+};
+
+// suppose phase is zero at t=0.0
+// phase of P(t) is a product of a factor of the row index (n1,n2) and a factor of the column index (n3,n4)
+inline void electronphonon::set_phase_rowcol(complex *phk, complex *phkp, bool minus, kpair_work& w){
+	// P1_n1n2,n3n4(t) = P1_n1n2,n3n4 * exp[i*t*(e^k_n1 - e^k_n2)] * exp[i*t*(- e^kp_n3 + e^kp_n4)]
+	// P2_n1n2,n3n4(t) = P2_n1n2,n3n4 * exp[i*t*(- e^kp_n1 + e^kp_n2)] * exp[i*t*(e^k_n3 - e^k_n4)]
+	for (int i1 = 0; i1 < nb; i1++)
+	for (int i2 = 0; i2 < nb; i2++){
+		complex pk = phk[i1] * conj(phk[i2]), pkp = conj(phkp[i1]) * phkp[i2];
+		w.phase_row[i1*nb + i2] = minus ? pkp : pk;
+		w.phase_col[i1*nb + i2] = minus ? pk : pkp;
+	}
+}
+inline void electronphonon::init_sparse_mat(sparse_mat *sin, sparse_mat *sout, bool copy_elem){
+	sout->i = sin->i; sout->j = sin->j; sout->ns = sin->ns; // sout->s has been allocated and will be rewritten, we should not set sout->s = sin->s
+	sout->rowptr = sin->rowptr; sout->nrow = sin->nrow;
+	if (copy_elem)
+	for (int is = 0; is < sin->ns; is++)
+		sout->s[is] = sin->s[is];
+}
+inline void electronphonon::compute_sPt(complex *phk, complex *phkp, sparse_mat *sm, sparse_mat *smt, bool minus, kpair_work& w){
+	init_sparse_mat(sm, smt);
+	// notice that P has four band indeces; sm->i and sm->j are combined band indeces (n1,n2) and (n3,n4)
+	set_phase_rowcol(phk, phkp, minus, w);
+	for (int is = 0; is < sm->ns; is++)
+		smt->s[is] = sm->s[is] * w.phase_row[sm->i[is]] * w.phase_col[sm->j[is]];
+}
+inline void electronphonon::compute_Pt(complex *phk, complex *phkp, complex *P, complex *Pt, bool minus, kpair_work& w){
+	// P1_n3n2,n4n5 = G^+-_n3n4 * conj(G^+-_n2n5) * nq^+-
+	// P1_n3n2,n4n5(t) = P1_n3n2,n4n5 * exp[i*t*(e^k_n3 - e^kp_n4 - e^k_n2 + e^kp_n5)]
+	// P2_n3n4,n1n5 = G^-+_n1n3 * conj(G^-+_n5n4) * nq^+-
+	// P2_n3n4,n1n5(t) = P2_n3n4,n1n5 * exp[i*t*(e^k_n1 - e^kp_n3 - e^k_n5 + e^kp_n4)]
+	set_phase_rowcol(phk, phkp, minus, w);
+	int nb2 = nb*nb;
+	for (int i12 = 0; i12 < nb2; i12++){
+		complex *Prow = P + i12*nb2, *Ptrow = Pt + i12*nb2;
+		for (int i34 = 0; i34 < nb2; i34++)
+			Ptrow[i34] = Prow[i34] * w.phase_row[i12] * w.phase_col[i34];
+	}
+}
\ No newline at end of file
@@ -139,7 +139,7 @@ void electronphonon::analyse_g2(double de, double degauss, double degthr){
 	//expected_size = nkpair_proc*nm * sizeof(double); // not right
 	//check_file_size(fpwq, expected_size, fname_wq + " size does not match expected size");
 
-	bool isI[nk_glob];
+	std::vector<bool> isI(nk_glob);
 	double sum_g2nq[nb*nb], **eig_sdeg = alloc_real_array(nk_glob, nb); // eigenvalues of energy-degeneracy projections of spin matrices
 	complex g[nb*nb], mtmp[nb*nb], **U_sdeg = alloc_array(nk_glob, nb*nb);
 	std::vector<double> nstates_e(ne);
@@ -495,7 +495,7 @@ void electronphonon::analyse_g2_ei(double de, double degauss, double degthr){
 	//size_t expected_size = nkpair_proc*nb*nb * 2 * sizeof(double); // not right
 	//check_file_size(fpg, expected_size, fname_g + " size does not match expected size");
 
-	bool isI[nk_glob];
+	std::vector<bool> isI(nk_glob);
 	double **eig_sdeg = alloc_real_array(nk_glob, nb); // eigenvalues of energy-degeneracy projections of spin matrices
 	complex g[nb*nb], mtmp[nb*nb], **U_sdeg = alloc_array(nk_glob, nb*nb);
 	std::vector<double> nstates_e(ne);
@@ -5,7 +5,7 @@ void electronphonon::set_Lsc(double **f_eq){
 
 	if (!alg.eph_enable){
 		zeros(Lscii, nk_glob, (int)std::pow(nb, 4));
-		zeros(Lscij, nkpair_proc, (int)std::pow(nb, 4)); zeros(Lscji, nkpair_proc, (int)std::pow(nb, 4));
+		if (sLscij == nullptr) { zeros(Lscij, nkpair_proc, (int)std::pow(nb, 4)); zeros(Lscji, nkpair_proc, (int)std::pow(nb, 4)); }
 	}
 	else set_Leph_from_jdftx_data();
 
@@ -27,14 +27,31 @@ void electronphonon::set_Lsc(double **f_eq){
 	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
 		int ik_glob = k1st[ikpair_local];
 		int ikp_glob = k2nd[ikpair_local];
-		if (ik_glob == ikp_glob){
+		if (ik_glob == ikp_glob && sLscij != nullptr)
+			add_sLsc(ikpair_local, Lscii[ik_glob], Lscii[ik_glob]);
+		else if (ik_glob == ikp_glob){
 			axbyc(Lscij[ikpair_local], Lscii[ik_glob], (int)std::pow(nb, 4), c1, c1);
 			axbyc(Lscji[ikpair_local], Lscii[ik_glob], (int)std::pow(nb, 4), c1, c1);
 		}
 	}
+	if (sLscij != nullptr){
+		sLscij->ns_tot = 0; sLscji->ns_tot = 0;
+		for (size_t ik = 0; ik < sLscij->nk; ik++) { sLscij->ns_tot += sLscij->smat[ik]->ns; sLscji->ns_tot += sLscji->smat[ik]->ns; }
+		if (ionode) printf("\nsparse Lscij and Lscji:");
+		sLscij->print_ns_tot(alg.thr_sparseP); sLscji->print_ns_tot(alg.thr_sparseP);
+	}
 	//set_sparseP(false);
 }
 
+// the rows of one k pair (computed densely) are merged into the sparse operator; as for sparse P, see add_sparseP,
+// the pattern is the union of all contributions and grows only if a contribution has elements outside of it
+void electronphonon::add_sLsc(int ikpair_local, complex *lij, complex *lji){
+	int nb2 = nb*nb;
+	sparse_mat *sij = sLscij->smat[ikpair_local], *sji = sLscji->smat[ikpair_local];
+	if (!sparse_plus_dense_fixed(sij, alg.thr_sparseP, lij, nb2, nb2, c1, c1)) sparse_union_plus_dense(sij, alg.thr_sparseP, lij, nb2, nb2, c1, c1);
+	if (!sparse_plus_dense_fixed(sji, alg.thr_sparseP, lji, nb2, nb2, c1, c1)) sparse_union_plus_dense(sji, alg.thr_sparseP, lji, nb2, nb2, c1, c1);
+}
+
 void electronphonon::add_Lsc_contrib(string what, int iD){
 	/*
 	ostringstream convert; convert << mp->myrank;
@@ -50,6 +67,9 @@ void electronphonon::add_Lsc_contrib(string what, int iD){
 	complex *P1add = new complex[(int)std::pow(nb, 4)]; complex *P2add = new complex[(int)std::pow(nb, 4)];
 	complex *P3add = new complex[(int)std::pow(nb, 4)]; complex *P4add = new complex[(int)std::pow(nb, 4)];
 	complex *P5add = new complex[(int)std::pow(nb, 4)]; complex *P6add = new complex[(int)std::pow(nb, 4)];
+	// with sparse Lsc, the rows of each k pair are accumulated here first
+	complex *Lij = sLscij == nullptr ? nullptr : new complex[(int)std::pow(nb, 4)];
+	complex *Lji = sLscij == nullptr ? nullptr : new complex[(int)std::pow(nb, 4)];
 
 	double nk3_accum = 0;
 	double scale_fac = scale_scatt;
@@ -60,6 +80,9 @@ void electronphonon::add_Lsc_contrib(string what, int iD){
 		int ikp_glob = k2nd[ikpair_local];
 		//if (ldebug) { fprintf(fp, "\nikpair=%d(%d) k1=%d k2=%d\n", ikpair_local, nkpair_proc, ik_glob, ikp_glob); fflush(fp); }
 		zeros(P1add, (int)std::pow(nb, 4)); zeros(P2add, (int)std::pow(nb, 4));
+		complex *lij = Lij, *lji = Lji;
+		if (sLscij == nullptr) { lij = Lscij[ikpair_local]; lji = Lscji[ikpair_local]; }
+		else { zeros(lij, (int)std::pow(nb, 4)); zeros(lji, (int)std::pow(nb, 4)); }
 
 		if (what == "eimp" && eip.impMode[iD] == "model_ionized") eimp[iD]->eimp_model->calc_P(ik_glob, ikp_glob, P1add, P2add, false);
 		if (what == "eimp" && eip.impMode[iD] == "ab_neutral") eimp[iD]->read_ldbd_imp_P(ikpair_local, P1add, P2add);
@@ -76,17 +99,18 @@ void electronphonon::add_Lsc_contrib(string what, int iD){
 		if (scale_fac != 1.) axbyc(P1add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
 		if (scale_fac != 1.) axbyc(P2add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
 		add_Lscii_from_P1_P2(P1add, P2add, ik_glob, ikp_glob);
-		add_Lscij_from_P1_P2(P1add, P2add, ikpair_local, ik_glob, ikp_glob, eep.antisymmetry);
+		add_Lscij_from_P1_P2(P1add, P2add, lij, lji, ik_glob, ikp_glob, eep.antisymmetry);
 		if (what == "ee" && eep.eeMode != "Pee_fixed_at_eq"){
 			if (!eep.antisymmetry){
 				if (scale_fac != 1.) axbyc(P3add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
 				if (scale_fac != 1.) axbyc(P4add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
-				add_Lscij_from_P3_P4(P3add, P4add, ikpair_local, ik_glob, ikp_glob);
+				add_Lscij_from_P3_P4(P3add, P4add, lij, lji, ik_glob, ikp_glob);
 			}
 			if (scale_fac != 1.) axbyc(P5add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
 			if (scale_fac != 1.) axbyc(P6add, nullptr, (int)std::pow(nb, 4), c0, complex(scale_fac, 0));
-			add_Lscij_from_P5_P6(P5add, P6add, ikpair_local, ik_glob, ikp_glob);
+			add_Lscij_from_P5_P6(P5add, P6add, lij, lji, ik_glob, ikp_glob);
 		}
+		if (sLscij != nullptr) add_sLsc(ikpair_local, lij, lji);
 		if (ionode && what == "ee" && ikpair_local % 1000 == 0)  printf("kpair %d done\n", ikpair_local);
 		//if (ldebug){
 		//	fprintf_complex_mat(fp, P1add, nb*nb, "P1add:"); fflush(fp);
@@ -94,53 +118,70 @@ void electronphonon::add_Lsc_contrib(string what, int iD){
 		//}
 	}
 	delete[] P1add; delete[] P2add; delete[] P3add; delete[] P4add; delete[] P5add; delete[] P6add;
+	delete[] Lij; delete[] Lji;
 	double max = nk3_accum, min = nk3_accum, avg = nk3_accum;
 	mp->allreduce(max, MPI_MAX); mp->allreduce(min, MPI_MIN); mp->allreduce(avg, MPI_SUM); avg /= mp->nprocs;
 	if (what == "ee" && ionode) printf("nk3_accum: max= %lg min= %lg avg = %lg\n", max, min, avg);
 
 	if (what == "eimp" && eimp[iD]->eimp_model != nullptr) eimp[iD]->eimp_model->reduce_imsig(this->mp);
 	if (what == "ee") ee_model->reduce_imsig(this->mp);
+	if (coul_model != nullptr && (what == "ee" || eimp[iD]->eimp_model != nullptr)) coul_model->ovlps->report(mp, what);
 	//if (ldebug) fclose(fp);
 }
 
 void electronphonon::set_Leph_from_jdftx_data(){
+	if (ionode) { printf("\nread P? matrices and linearize them\n"); fflush(stdout); }
+	string suffix = isHole ? alg.scatt + "_hole" : alg.scatt;
+	size_t Psize = (size_t)std::pow(nb, 4);
+	ldbd_file *fp1 = nullptr, *fp2 = nullptr; // each process reads its own k pairs
+	sparse2D *sP1in = nullptr, *sP2in = nullptr; // sparse P is only needed here, k pair by k pair
 	if (!alg.Pin_is_sparse){
-		if (ionode) { printf("\nread P? matrices and linearize them\n"); fflush(stdout); }
-		string fname1 = "ldbd_data/ldbd_P1_", fname2 = "ldbd_data/ldbd_P2_", suffix;
-		suffix = isHole ? alg.scatt + "_hole" : alg.scatt;
-		fname1 += (suffix + ".bin"); fname2 += (suffix + ".bin");
-
-		size_t Psize = (size_t)std::pow(nb, 4);
+		string fname1 = "ldbd_data/ldbd_P1_" + suffix + ".bin", fname2 = "ldbd_data/ldbd_P2_" + suffix + ".bin";
 		size_t expected_size = nkpair_glob*Psize * 2 * sizeof(double);
 
-		FILE *fp1 = fopen(fname1.c_str(), "rb");
-		check_file_size(fp1, expected_size, fname1 + " size does not match expected size");
-		fseek_bigfile(fp1, ikpair0_glob, Psize * 2 * sizeof(double));
-		FILE *fp2 = fopen(fname2.c_str(), "rb");
-		check_file_size(fp2, expected_size, fname1 + " size does not match expected size");
-		fseek_bigfile(fp2, ikpair0_glob, Psize * 2 * sizeof(double));
-
-		MPI_Barrier(MPI_COMM_WORLD);
-		complex *P1add = new complex[(int)std::pow(nb, 4)]; complex *P2add = new complex[(int)std::pow(nb, 4)];
-		for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
-			int ik_glob = k1st[ikpair_local];
-			int ikp_glob = k2nd[ikpair_local];
-			fread(P1add, 2 * sizeof(double), Psize, fp1);
-			fread(P2add, 2 * sizeof(double), Psize, fp2);
-			if (scale_eph != 1.) axbyc(P1add, nullptr, Psize, c0, complex(scale_eph, 0));
-			if (scale_eph != 1.) axbyc(P2add, nullptr, Psize, c0, complex(scale_eph, 0));
-			add_Lscii_from_P1_P2(P1add, P2add, ik_glob, ikp_glob);
-			add_Lscij_from_P1_P2(P1add, P2add, ikpair_local, ik_glob, ikp_glob);
-		}
-		MPI_Barrier(MPI_COMM_WORLD);
-		delete[] P1add; delete[] P2add;
-
-		fclose(fp1);
-		fclose(fp2);
+		fp1 = new ldbd_file(fname1, false);
+		fp1->check_size(expected_size, fname1 + " size does not match expected size");
+		fp1->seek(ikpair0_glob, Psize * 2 * sizeof(double));
+		fp2 = new ldbd_file(fname2, false);
+		fp2->check_size(expected_size, fname1 + " size does not match expected size");
+		fp2->seek(ikpair0_glob, Psize * 2 * sizeof(double));
 	}
 	else{
-		error_message("linearization for sparse P matrices is not implemented");
+		sP1in = sparse2D::read_sparseP(mp, "ldbd_data/sP1_" + suffix, nb*nb, nb*nb);
+		sP2in = sparse2D::read_sparseP(mp, "ldbd_data/sP2_" + suffix, nb*nb, nb*nb);
 	}
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	complex *P1add = new complex[(int)std::pow(nb, 4)]; complex *P2add = new complex[(int)std::pow(nb, 4)];
+	complex *Lij = sLscij == nullptr ? nullptr : new complex[(int)std::pow(nb, 4)];
+	complex *Lji = sLscij == nullptr ? nullptr : new complex[(int)std::pow(nb, 4)];
+	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
+		int ik_glob = k1st[ikpair_local];
+		int ikp_glob = k2nd[ikpair_local];
+		if (!alg.Pin_is_sparse){
+			fp1->read(P1add, 2 * sizeof(double), Psize);
+			fp2->read(P2add, 2 * sizeof(double), Psize);
+		}
+		else{
+			sP1in->smat[ikpair_local]->todense(P1add, nb*nb, nb*nb);
+			sP2in->smat[ikpair_local]->todense(P2add, nb*nb, nb*nb);
+		}
+		if (scale_eph != 1.) axbyc(P1add, nullptr, Psize, c0, complex(scale_eph, 0));
+		if (scale_eph != 1.) axbyc(P2add, nullptr, Psize, c0, complex(scale_eph, 0));
+		add_Lscii_from_P1_P2(P1add, P2add, ik_glob, ikp_glob);
+		if (sLscij == nullptr)
+			add_Lscij_from_P1_P2(P1add, P2add, Lscij[ikpair_local], Lscji[ikpair_local], ik_glob, ikp_glob);
+		else{
+			zeros(Lij, (int)Psize); zeros(Lji, (int)Psize);
+			add_Lscij_from_P1_P2(P1add, P2add, Lij, Lji, ik_glob, ikp_glob);
+			add_sLsc(ikpair_local, Lij, Lji);
+		}
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+	delete[] P1add; delete[] P2add; delete[] Lij; delete[] Lji;
+
+	if (fp1 != nullptr) { delete fp1; delete fp2; }
+	if (sP1in != nullptr) { delete sP1in; delete sP2in; }
 }
 
 void electronphonon::add_Lscii_from_P1_P2(complex *P1_ikjk, complex *P2_ikjk, int ik, int jk){
@@ -177,7 +218,7 @@ void electronphonon::add_Lscii_from_P1_P2(complex *P1_ikjk, complex *P2_ikjk, in
 	}
 }
 
-void electronphonon::add_Lscij_from_P1_P2(complex *P1, complex *P2, int ikpair_local, int ik, int jk, bool fac2){
+void electronphonon::add_Lscij_from_P1_P2(complex *P1, complex *P2, complex *Lscij, complex *Lscji, int ik, int jk, bool fac2){
 	for (int i1 = 0; i1 < nb; i1++)
 	for (int i2 = 0; i2 < nb; i2++){
 		int i12 = i1*nb + i2;
@@ -190,18 +231,18 @@ void electronphonon::add_Lscij_from_P1_P2(complex *P1, complex *P2, int ikpair_l
 			// ddmdt^ik_12 = 2 (1-f^ik_1) P1^ikjk_{12,ab} ddm^jk_ab
 			// ddmdt^ik_12 = 2 P2^ikjk_{ab,12} f^ik_2 ddm^jk_ab
 			complex ctmp = ((1 - f_eq[ik][i1]) * P1[i12ab] + P2[iab12] * f_eq[ik][i2]);
-			Lscij[ikpair_local][i12ab] += (fac2 ? 2 * ctmp : ctmp);
+			Lscij[i12ab] += (fac2 ? 2 * ctmp : ctmp);
 			// ddmdt^jk_12 = 2 (1-f^jk_1) P1^jkik_{12,ab} ddm^ik_ab 
 			//             = 2 (1-f^jk_1) conj(P2^ikjk_{12,ab}) ddm^ik_ab
 			// ddmdt^jk_12 = 2 P2^jkik_{ab,12} f^jk_2 ddm^ik_ab
 			//             = 2 conj(P1^ikjk_{ab,12}) f^jk_2 ddm^ik_ab
 			ctmp = ((1 - f_eq[jk][i1]) * conj(P2[i12ab]) + conj(P1[iab12]) * f_eq[jk][i2]);
-			Lscji[ikpair_local][i12ab] += (fac2 ? 2 * ctmp : ctmp);
+			Lscji[i12ab] += (fac2 ? 2 * ctmp : ctmp);
 		}
 	}
 }
 
-void electronphonon::add_Lscij_from_P3_P4(complex *P3, complex *P4, int ikpair_local, int ik, int jk){
+void electronphonon::add_Lscij_from_P3_P4(complex *P3, complex *P4, complex *Lscij, complex *Lscji, int ik, int jk){
 	for (int i1 = 0; i1 < nb; i1++)
 	for (int i2 = 0; i2 < nb; i2++){
 		int i12 = i1*nb + i2;
@@ -213,17 +254,17 @@ void electronphonon::add_Lscij_from_P3_P4(complex *P3, complex *P4, int ikpair_l
 			int iab12 = iab*nb*nb + i12;
 			// ddmdt^ik_12 = -(1-f^ik_1) P3^ikjk_{12,ab} ddm^jk_ab
 			// ddmdt^ik_12 = -P4^ikjk_{12,ab} f^ik_2 ddm^jk_ab
-			Lscij[ikpair_local][i12ab] -= ((1 - f_eq[ik][i1]) * P3[i12ab] + P4[i12ab] * f_eq[ik][i2]);
+			Lscij[i12ab] -= ((1 - f_eq[ik][i1]) * P3[i12ab] + P4[i12ab] * f_eq[ik][i2]);
 			// ddmdt^jk_12 = -(1-f^jk_1) P3^jkik_{12,ab} ddm^ik_ab
 			//             = -(1-f^jk_1) conj(P4^ikjk_{ab,12}) ddm^ik_ab
 			// ddmdt^jk_12 = -P4^jkik_{12,ab} f^jk_2 ddm^ik_ab
 			//             = -conj(P3^ikjk_{ab,12}) f^jk_2 ddm^ik_ab
-			Lscji[ikpair_local][i12ab] -= ((1 - f_eq[jk][i1]) * conj(P4[iab12]) + conj(P3[iab12]) * f_eq[jk][i2]);
+			Lscji[i12ab] -= ((1 - f_eq[jk][i1]) * conj(P4[iab12]) + conj(P3[iab12]) * f_eq[jk][i2]);
 		}
 	}
 }
 
-void electronphonon::add_Lscij_from_P5_P6(complex *P5, complex *P6, int ikpair_local, int ik, int jk){
+void electronphonon::add_Lscij_from_P5_P6(complex *P5, complex *P6, complex *Lscij, complex *Lscji, int ik, int jk){
 	for (int i1 = 0; i1 < nb; i1++)
 	for (int i2 = 0; i2 < nb; i2++){
 		int n12 = (i1*nb + i2)*nb*nb;
@@ -234,12 +275,12 @@ void electronphonon::add_Lscij_from_P5_P6(complex *P5, complex *P6, int ikpair_l
 			int iba21 = (ib*nb + ia)*nb*nb + i21;
 			// ddmdt^ik_12 = -(1-f^ik_1) P5^ikjk_{12,ab} ddm^jk_ab
 			// ddmdt^ik_12 = -P6^ikjk_{12,ab} f^ik_2 ddm^jk_ab
-			Lscij[ikpair_local][i12ab] -= ((1 - f_eq[ik][i1]) * P5[i12ab] + P6[i12ab] * f_eq[ik][i2]);
+			Lscij[i12ab] -= ((1 - f_eq[ik][i1]) * P5[i12ab] + P6[i12ab] * f_eq[ik][i2]);
 			// ddmdt^jk_12 = -(1-f^jk_1) P5^jkik_{12,ab} ddm^ik_ab
 			//             = -(1-f^jk_1) P5^ikjk_{ba,21} ddm^ik_ab
 			// ddmdt^jk_12 = -P6^jkik_{12,ab} f^jk_2 ddm^ik_ab
 			//             = -P6^ikjk_{ba,21} f^jk_2 ddm^ik_ab
-			Lscji[ikpair_local][i12ab] -= ((1 - f_eq[jk][i1]) * P5[iba21] + P6[iba21] * f_eq[jk][i2]);
+			Lscji[i12ab] -= ((1 - f_eq[jk][i1]) * P5[iba21] + P6[iba21] * f_eq[jk][i2]);
 		}
 	}
 }
\ No newline at end of file
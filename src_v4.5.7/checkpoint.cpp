@@ -0,0 +1,208 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+void restart_state::write(FILE *fp) const{
+	fprintf(fp, "version %d\n", version);
+	fprintf(fp, "t %21.14le\n", t);
+	fprintf(fp, "it %d\n", it);
+	fprintf(fp, "h %21.14le\n", h);
+	fprintf(fp, "mue %21.14le\n", mue);
+	fprintf(fp, "muh %21.14le\n", muh);
+	fprintf(fp, "it_scatt %d\n", it_scatt);
+	fprintf(fp, "t_scatt %21.14le\n", t_scatt);
+}
+
+bool restart_state::read(string fname){
+	FILE *fp = fopen(fname.c_str(), "r");
+	if (fp == nullptr) return false;
+	char s[200], key[100];
+	int ver = 0;
+	while (fgets(s, sizeof s, fp) != NULL){
+		double val;
+		if (sscanf(s, "%99s %le", key, &val) != 2) continue;
+		string k(key);
+		if (k == "version") ver = (int)val;
+		else if (k == "t") t = val;
+		else if (k == "it") it = (int)val;
+		else if (k == "h") h = val;
+		else if (k == "mue") mue = val;
+		else if (k == "muh") muh = val;
+		else if (k == "it_scatt") it_scatt = (int)val;
+		else if (k == "t_scatt") t_scatt = val;
+	}
+	fclose(fp);
+	if (ver < 1 || ver > version) error_message(fname + " has an unsupported version", "restart_state::read");
+	return true;
+}
+
+dm_checkpoint::dm_checkpoint(mymp *mp, int nk_glob, int nb, bool async, string name)
+	: mp(mp), nk_glob(nk_glob), nb(nb), ik0(mp->varstart), ik1(mp->varend), async(async), pending(false),
+	t_pending(0), t_written(-DBL_MAX), has_state(false), ok(1), hash(0),
+	fname("restart/" + name + ".bin"), fname_chk("restart/" + name + ".chk"), fname_commit("restart/" + name + ".commit")
+{
+	if (async) snapshot.resize((ik1 - ik0)*nb*nb);
+}
+
+unsigned long long dm_checkpoint::hash_row(size_t ik, const complex *row, int n){
+	unsigned long long h = 1469598103934665603ULL;
+	auto add = [&h](const unsigned char *p, size_t nbyte){
+		for (size_t i = 0; i < nbyte; i++){ h ^= p[i]; h *= 1099511628211ULL; }
+	};
+	unsigned long long ik64 = ik;
+	add((const unsigned char*)&ik64, sizeof(ik64));
+	add((const unsigned char*)row, n * sizeof(complex));
+	return h;
+}
+
+void dm_checkpoint::write_rows(const complex *rows){
+	size_t nrow = (size_t)nb*nb;
+	hash = 0; ok = 1;
+	for (size_t ik = ik0; ik < ik1; ik++)
+		hash ^= hash_row(ik, rows + (ik - ik0)*nrow, (int)nrow);
+	if (ik1 == ik0) return;
+
+	int fd = open((fname + ".tmp").c_str(), O_WRONLY);
+	if (fd < 0){ ok = 0; return; }
+	const char *p = (const char*)rows;
+	size_t nbyte = (ik1 - ik0)*nrow*sizeof(complex);
+	off_t offset = (off_t)(ik0*nrow*sizeof(complex));
+	while (nbyte > 0){
+		ssize_t nw = pwrite(fd, p, nbyte, offset);
+		if (nw <= 0){ ok = 0; break; }
+		p += nw; nbyte -= nw; offset += nw;
+	}
+	if (fsync(fd) != 0) ok = 0;
+	close(fd);
+}
+
+void dm_checkpoint::write(double t, complex **dm, const restart_state *state){
+	finish();
+	if (t == t_written) return;
+	// the temporary file has its final size before any process writes into it
+	int ok_create = 1;
+	if (ionode){
+		int fd = open((fname + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0 || ftruncate(fd, (off_t)nk_glob*nb*nb*sizeof(complex)) != 0) ok_create = 0;
+		if (fd >= 0) close(fd);
+	}
+	MPI_Bcast(&ok_create, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	if (!ok_create) error_message("cannot create " + fname + ".tmp", "dm_checkpoint::write");
+
+	t_pending = t; pending = true;
+	has_state = state != nullptr;
+	if (has_state) state_pending = *state;
+	if (async){
+		if (ik1 > ik0) std::copy(dm[ik0], dm[ik0] + (ik1 - ik0)*nb*nb, snapshot.begin());
+		writer = std::thread(&dm_checkpoint::write_rows, this, snapshot.data());
+	}
+	else{
+		write_rows(dm[0] + ik0*nb*nb);
+		finish();
+	}
+}
+
+void dm_checkpoint::finish(){
+	if (!pending) return;
+	if (writer.joinable()) writer.join();
+	pending = false;
+
+	int ok_all = 0;
+	unsigned long long hash_all = 0;
+	MPI_Allreduce(&ok, &ok_all, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+	MPI_Reduce(&hash, &hash_all, 1, MPI_UNSIGNED_LONG_LONG, MPI_BXOR, 0, MPI_COMM_WORLD);
+	if (!ok_all) error_message("writing " + fname + ".tmp failed", "dm_checkpoint::finish");
+	if (ionode){
+		auto close_synced = [](FILE *fp){ return fflush(fp) == 0 && fsync(fileno(fp)) == 0 && fclose(fp) == 0; };
+		bool ok_small = true;
+		FILE *fp = fopen((fname_chk + ".tmp").c_str(), "w");
+		if (fp == nullptr) error_message("cannot create " + fname_chk + ".tmp", "dm_checkpoint::finish");
+		fprintf(fp, "%21.14le %d %d %016llx\n", t_pending, nk_glob, nb, hash_all);
+		ok_small = close_synced(fp) && ok_small;
+		if (has_state){
+			fp = fopen((fname_state + ".tmp").c_str(), "w");
+			if (fp == nullptr) error_message("cannot create " + fname_state + ".tmp", "dm_checkpoint::finish");
+			state_pending.write(fp);
+			ok_small = close_synced(fp) && ok_small;
+			fp = fopen((fname_time + ".tmp").c_str(), "w");
+			if (fp == nullptr) error_message("cannot create " + fname_time + ".tmp", "dm_checkpoint::finish");
+			fprintf(fp, "%21.14le", t_pending); // full precision, so that the restarted run continues at exactly this time
+			ok_small = close_synced(fp) && ok_small;
+		}
+		if (!ok_small) error_message("cannot write checkpoint files", "dm_checkpoint::finish");
+
+		// commit point: the marker lists the files of this checkpoint
+		fp = fopen((fname_commit + ".tmp").c_str(), "w");
+		if (fp == nullptr) error_message("cannot create " + fname_commit + ".tmp", "dm_checkpoint::finish");
+		fprintf(fp, "%s\n%s\n", fname.c_str(), fname_chk.c_str());
+		if (has_state) fprintf(fp, "%s\n%s\n", fname_state.c_str(), fname_time.c_str());
+		if (!close_synced(fp) || rename((fname_commit + ".tmp").c_str(), fname_commit.c_str()) != 0)
+			error_message("cannot write " + fname_commit, "dm_checkpoint::finish");
+		roll_forward(fname_commit);
+	}
+	t_written = t_pending;
+}
+
+// renames the temporary files listed in the marker that are still there, then removes the marker
+void dm_checkpoint::roll_forward(string fname_commit){
+	FILE *fp = fopen(fname_commit.c_str(), "r");
+	if (fp == nullptr) return;
+	char s[500];
+	while (fgets(s, sizeof s, fp) != NULL){
+		string f(s);
+		while (!f.empty() && (f.back() == '\n' || f.back() == '\r')) f.pop_back();
+		if (f.empty() || !exists(f + ".tmp")) continue; // renamed before the run stopped
+		if (rename((f + ".tmp").c_str(), f.c_str()) != 0)
+			error_message("cannot rename " + f + ".tmp", "dm_checkpoint::roll_forward");
+	}
+	fclose(fp);
+	if (remove(fname_commit.c_str()) != 0) error_message("cannot remove " + fname_commit, "dm_checkpoint::roll_forward");
+}
+
+void dm_checkpoint::recover(){
+	if (ionode)
+	for (string name : { "denmat_restart", "denmat_scatt_restart" }){
+		string fname_commit = "restart/" + name + ".commit";
+		if (!exists(fname_commit)) continue;
+		printf("%s found, complete the interrupted checkpoint\n", fname_commit.c_str());
+		roll_forward(fname_commit);
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void dm_checkpoint::read(complex **dm){
+	if (ionode) printf("\nread %s:\n", fname.c_str());
+	size_t nrow = (size_t)nb*nb;
+	FILE *fp = fopen(fname.c_str(), "rb");
+	if (fp == nullptr) error_message("restart needs " + fname, "dm_checkpoint::read");
+	check_file_size(fp, nk_glob*nrow*sizeof(complex), fname + " size does not match expected size");
+	if (ik1 > ik0){
+		fseek_bigfile(fp, ik0, nrow*sizeof(complex));
+		if (fread(dm[ik0], sizeof(complex), (ik1 - ik0)*nrow, fp) != (ik1 - ik0)*nrow)
+			error_message("cannot read " + fname, "dm_checkpoint::read");
+	}
+	fclose(fp);
+
+	unsigned long long h = 0, hash_all = 0;
+	for (size_t ik = ik0; ik < ik1; ik++)
+		h ^= hash_row(ik, dm[ik], (int)nrow);
+	MPI_Allreduce(&h, &hash_all, 1, MPI_UNSIGNED_LONG_LONG, MPI_BXOR, MPI_COMM_WORLD);
+	mp->allgather(dm, nk_glob, (int)nrow);
+
+	// restart directories of older versions have no checksum
+	int status = 0; // 0: no checksum file, 1: verified, -1: mismatch
+	if (ionode){
+		if (FILE *fchk = fopen(fname_chk.c_str(), "r")){
+			double t; int nk_chk, nb_chk; unsigned long long hash_chk;
+			if (fscanf(fchk, "%le %d %d %llx", &t, &nk_chk, &nb_chk, &hash_chk) == 4)
+				status = (nk_chk == nk_glob && nb_chk == nb && hash_chk == hash_all) ? 1 : -1;
+			else
+				status = -1;
+			fclose(fchk);
+		}
+		if (status == 1) printf("checksum of %s verified\n", fname.c_str());
+		if (status == 0) printf("%s does not exist, checksum is not verified\n", fname_chk.c_str());
+	}
+	MPI_Bcast(&status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	if (status < 0) error_message(fname + " does not match " + fname_chk, "dm_checkpoint::read");
+}
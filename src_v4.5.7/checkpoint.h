@@ -0,0 +1,60 @@
+#pragma once
+#include "common_headers.h"
+#include <float.h>
+#include <thread>
+
+// integrator state saved with each checkpoint in restart/state_restart.dat, "key value" lines starting with "version"
+// unknown keys are skipped, so that later versions can add keys; restart directories without this file only restore dm and t
+struct restart_state{
+	static const int version = 1;
+	int it; // last completed time step, so that all it-based cadences continue
+	double t, h; // h: next trial step of the adaptive integrator, 0 if none
+	double mue, muh; // initial guesses of the chemical potentials in set_dm_eq
+	int it_scatt; // step of the last update of the scattering models outside the right-hand side, 0: none;
+	double t_scatt; // the density matrix of that update is in restart/denmat_scatt_restart.bin
+
+	restart_state() : it(0), t(0), h(0), mue(0), muh(0), it_scatt(0), t_scatt(0) {}
+	void write(FILE *fp) const;
+	bool read(string fname); // false if the file does not exist
+};
+
+// restart checkpoints of the density matrix, written with their own cadence (freq_checkpoint)
+// restart/denmat_restart.bin keeps its layout, dm[ik][i*nb + j] in global k order, so it can be read with any number of processes
+// writing: every process writes the rows of its own k range into one shared temporary file with pwrite;
+// restart/denmat_restart.chk: t, nk, nb and a checksum, the xor over k of the FNV-1a hash of (ik, row ik)
+// commit: when all temporary files (.bin, .chk and with a state, state_restart.dat and time_restart.dat) are on disk,
+// ionode creates restart/denmat_restart.commit by a rename, which lists them, then renames them and removes the marker;
+// if the run stops in between, recover (before the restart files are read) completes the renames, so the files of
+// a checkpoint are always all from the same one
+// async: the own rows are copied and written by a background thread, which makes no MPI calls;
+// the collective part (error check, checksum reduction, commit) is done at the next write or at finish
+class dm_checkpoint{
+public:
+	dm_checkpoint(mymp *mp, int nk_glob, int nb, bool async, string name = "denmat_restart");
+	~dm_checkpoint(){ if (writer.joinable()) writer.join(); }
+
+	// collective; state (written on ionode) goes to restart/state_restart.dat together with dm
+	void write(double t, complex **dm, const restart_state *state = nullptr);
+	void finish(); // collective; completes a pending write
+	void read(complex **dm); // collective; dm is replicated on all processes
+	static void recover(); // collective; completes the commit of checkpoints interrupted after their marker
+
+	static unsigned long long hash_row(size_t ik, const complex *row, int n);
+
+private:
+	mymp *mp;
+	int nk_glob, nb;
+	size_t ik0, ik1;
+	bool async, pending;
+	double t_pending, t_written;
+	restart_state state_pending;
+	bool has_state;
+	std::vector<complex> snapshot;
+	std::thread writer;
+	int ok; // written by the thread
+	unsigned long long hash; // written by the thread
+	const string fname, fname_chk, fname_commit, fname_time = "restart/time_restart.dat", fname_state = "restart/state_restart.dat";
+
+	void write_rows(const complex *rows);
+	static void roll_forward(string fname_commit);
+};
@@ -2,6 +2,9 @@
 #include <scalar.h>
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_odeiv2.h>
+#include "ODE_ros2.h"
+#include "ODE_expmv.h"
+#include "ODE_eigen.h"
 
 static void copy_complex_from_real(complex **a, const double b[], size_t n){ // n is size of a
 	for (int i = 0; i < n; i++)
@@ -18,6 +21,7 @@ struct ODEparameters{
 public:
 	int ncalls;
 	double hstart, hmin, hmax, hmax_laser, epsabs;
+	int krylov_dim; double krylov_tol; // GMRES of ros2; Arnoldi of expmv (only krylov_dim)
 };
 
 extern ODEparameters ode;
\ No newline at end of file
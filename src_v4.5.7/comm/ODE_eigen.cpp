@@ -0,0 +1,159 @@
+#include "ODE_eigen.h"
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+#include "myarray.h"
+#include "mymatrix.h"
+#include "myio.h"
+
+ode_slowmodes::ode_slowmodes(ode_rhs f, void *params, size_t n, double tau, double epsabs, int krylov_dim_inner, int krylov_dim)
+	: nrestart_done(0), nmatvec(0), f(f), params(params), n(n), tau(tau), K(std::max(krylov_dim, 2))
+{
+	expmv = new ode_expmv(rhs_lin, this, n, epsabs, krylov_dim_inner);
+	b = alloc_aligned_real_array(n); w = alloc_aligned_real_array(n);
+	V = new double*[K + 1];
+	for (int i = 0; i <= K; i++)
+		V[i] = alloc_aligned_real_array(n);
+}
+ode_slowmodes::~ode_slowmodes(){
+	delete expmv;
+	dealloc_aligned_real_array(b); dealloc_aligned_real_array(w);
+	for (int i = 0; i <= K; i++)
+		dealloc_aligned_real_array(V[i]);
+	delete[] V;
+}
+
+int ode_slowmodes::rhs_lin(double t, const double y[], double dydt[], void *params){
+	ode_slowmodes *s = (ode_slowmodes*)params;
+	s->f(t, y, dydt, s->params); s->nmatvec++;
+	for (size_t i = 0; i < s->n; i++)
+		dydt[i] -= s->b[i];
+	return 0;
+}
+
+void ode_slowmodes::apply_B(const double v[], double bv[]){
+	for (size_t i = 0; i < n; i++)
+		bv[i] = v[i];
+	double t = 0;
+	if (expmv->apply(&t, tau, bv) != 0) error_message("exponential propagator cannot reach the tolerance", "ode_slowmodes::apply_B");
+}
+
+int ode_slowmodes::solve(const double v0[], int nmodes, int nrestart, double tol){
+	nmodes = std::min(nmodes, K - 1);
+	// b = f(0), so that f(v) - b = A v
+	for (size_t i = 0; i < n; i++)
+		w[i] = 0;
+	f(0, w, b, params);
+
+	double nrm = 0;
+	for (size_t i = 0; i < n; i++)
+		nrm += v0[i] * v0[i];
+	nrm = sqrt(nrm);
+	if (nrm == 0) error_message("starting vector is zero", "ode_slowmodes::solve");
+	for (size_t i = 0; i < n; i++)
+		V[0][i] = v0[i] / nrm;
+
+	std::vector<double> H((K + 1)*K);
+	std::vector<complex> Hc, mu, S;
+	std::vector<int> order;
+	int kk = 0, nconv = 0;
+	for (int irestart = 0; irestart <= nrestart; irestart++){
+		std::fill(H.begin(), H.end(), 0.);
+		double hlast = 0;
+		kk = K;
+		for (int j = 0; j < K; j++){
+			apply_B(V[j], w);
+			for (int i = 0; i <= j; i++){
+				double hij = 0;
+				for (size_t l = 0; l < n; l++)
+					hij += w[l] * V[i][l];
+				H[i*K + j] = hij;
+				for (size_t l = 0; l < n; l++)
+					w[l] -= hij * V[i][l];
+			}
+			double s = 0;
+			for (size_t l = 0; l < n; l++)
+				s += w[l] * w[l];
+			hlast = sqrt(s);
+			if (hlast <= 1e-12 * fabs(H[j*K + j]) || hlast == 0){ kk = j + 1; hlast = 0; break; } // invariant subspace
+			H[(j + 1)*K + j] = hlast;
+			for (size_t l = 0; l < n; l++)
+				V[j + 1][l] = w[l] / hlast;
+		}
+
+		// eigenpairs of the kk x kk Hessenberg matrix (column major for LAPACK)
+		Hc.assign(kk*kk, c0); mu.assign(kk, c0); S.assign(kk*kk, c0);
+		for (int i = 0; i < kk; i++)
+		for (int j = 0; j < kk; j++)
+			Hc[i + j*kk] = H[i*K + j];
+		char jobvl = 'N', jobvr = 'V';
+		int N = kk, ldvl = 1, lwork = 4 * kk, info = 0;
+		std::vector<complex> work(lwork); std::vector<double> rwork(2 * kk); complex vl[1];
+		zgeev_(&jobvl, &jobvr, &N, Hc.data(), &N, mu.data(), vl, &ldvl, S.data(), &N, work.data(), &lwork, rwork.data(), &info);
+		if (info != 0) error_message("zgeev failed", "ode_slowmodes::solve");
+
+		order.resize(kk);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&mu](int a, int c){ return mu[a].abs() > mu[c].abs(); });
+		int nm = std::min(nmodes, kk);
+		residual.assign(nm, 0); lambda.assign(nm, c0);
+		nconv = 0;
+		for (int im = 0; im < nm; im++){
+			int ie = order[im];
+			double snorm = 0;
+			for (int i = 0; i < kk; i++)
+				snorm += S[i + ie*kk].norm();
+			residual[im] = hlast * S[kk - 1 + ie*kk].abs() / sqrt(snorm) / std::max(mu[ie].abs(), 1e-300);
+			lambda[im] = complex(log(mu[ie].abs()), mu[ie].arg()) / tau;
+			if (residual[im] <= tol) nconv++;
+		}
+		nrestart_done = irestart;
+		if (nconv == nm || irestart == nrestart || hlast == 0) break;
+
+		// restart vector: sum of the real and imaginary parts of the wanted Ritz vectors
+		for (size_t l = 0; l < n; l++)
+			w[l] = 0;
+		for (int im = 0; im < nm; im++){
+			int ie = order[im];
+			for (int i = 0; i < kk; i++){
+				double c = S[i + ie*kk].real() + S[i + ie*kk].imag();
+				for (size_t l = 0; l < n; l++)
+					w[l] += c * V[i][l];
+			}
+		}
+		nrm = 0;
+		for (size_t l = 0; l < n; l++)
+			nrm += w[l] * w[l];
+		nrm = sqrt(nrm);
+		if (nrm == 0) break;
+		for (size_t l = 0; l < n; l++)
+			V[0][l] = w[l] / nrm;
+	}
+
+	// Ritz vectors; lambda from log(mu) / tau is only defined up to multiples of 2 pi i / tau,
+	// so it is replaced by the Rayleigh quotient x^H A x, which is exact for an exact eigenvector
+	int nm = (int)lambda.size();
+	std::vector<double> ax(n);
+	x_re.assign(nm, std::vector<double>(n, 0.)); x_im.assign(nm, std::vector<double>(n, 0.));
+	for (int im = 0; im < nm; im++){
+		int ie = order[im];
+		for (int i = 0; i < kk; i++)
+		for (size_t l = 0; l < n; l++){
+			x_re[im][l] += S[i + ie*kk].real() * V[i][l];
+			x_im[im][l] += S[i + ie*kk].imag() * V[i][l];
+		}
+		double s = 0;
+		for (size_t l = 0; l < n; l++)
+			s += x_re[im][l] * x_re[im][l] + x_im[im][l] * x_im[im][l];
+		s = sqrt(s);
+		if (s == 0) continue;
+		for (size_t l = 0; l < n; l++){ x_re[im][l] /= s; x_im[im][l] /= s; }
+		double rr = 0, ri = 0, ir = 0, ii = 0;
+		rhs_lin(0, x_re[im].data(), ax.data(), this);
+		for (size_t l = 0; l < n; l++){ rr += x_re[im][l] * ax[l]; ir += x_im[im][l] * ax[l]; }
+		rhs_lin(0, x_im[im].data(), ax.data(), this);
+		for (size_t l = 0; l < n; l++){ ri += x_re[im][l] * ax[l]; ii += x_im[im][l] * ax[l]; }
+		lambda[im] = complex(rr + ii, ri - ir);
+	}
+	return nconv;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include <scalar.h>
+#include "ODE_expmv.h"
+
+// slowest-decaying eigenmodes of an autonomous affine problem dy/dt = f(y) = A y + b
+// Arnoldi on the exponential transform B = exp(tau A): eigenvalues lambda of A with the smallest decay rates -Re(lambda)
+// are the eigenvalues mu = exp(tau lambda) of B with the largest modulus, and fast modes are damped by exp(-tau |Re lambda|);
+// B v is one run of ode_expmv on dv/dt = f(v) - f(0), so only right-hand-side calls are needed
+// explicit restarts with the real and imaginary parts of the wanted Ritz vectors until the residuals are below tol
+class ode_slowmodes{
+public:
+	std::vector<complex> lambda; // eigenvalues of A, slowest decay first
+	std::vector<double> residual; // |B x - mu x| / |mu| of the normalized Ritz vectors
+	std::vector<std::vector<double>> x_re, x_im; // Ritz vectors, normalized
+	int nrestart_done, nmatvec;
+
+	ode_slowmodes(ode_rhs f, void *params, size_t n, double tau, double epsabs, int krylov_dim_inner, int krylov_dim);
+	~ode_slowmodes();
+
+	// v0: starting vector, e.g. the initial perturbation; returns the number of converged modes
+	int solve(const double v0[], int nmodes, int nrestart, double tol);
+
+private:
+	ode_rhs f;
+	void *params;
+	size_t n;
+	double tau;
+	int K;
+	ode_expmv *expmv;
+	double *b, *w;
+	double **V;
+	static int rhs_lin(double t, const double y[], double dydt[], void *params);
+	void apply_B(const double v[], double bv[]);
+};
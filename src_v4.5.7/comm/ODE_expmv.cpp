@@ -0,0 +1,164 @@
+#include "ODE_expmv.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "myarray.h"
+
+void expm_small(const double *A, int n, double *E){
+	double norm = 0;
+	for (int i = 0; i < n; i++){
+		double s = 0;
+		for (int j = 0; j < n; j++)
+			s += fabs(A[i*n + j]);
+		norm = std::max(norm, s);
+	}
+	int nsq = norm > 0.5 ? (int)ceil(log2(norm / 0.5)) : 0;
+	double scale = ldexp(1., -nsq);
+
+	std::vector<double> X(n*n), T(n*n), tmp(n*n);
+	for (int i = 0; i < n*n; i++)
+		X[i] = A[i] * scale;
+	// E = I + X + X^2/2! + ... ; with ||X|| <= 0.5, 18 terms are beyond double precision
+	for (int i = 0; i < n*n; i++){ E[i] = 0; T[i] = 0; }
+	for (int i = 0; i < n; i++){ E[i*n + i] = 1; T[i*n + i] = 1; }
+	for (int k = 1; k <= 18; k++){
+		for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++){
+			double s = 0;
+			for (int l = 0; l < n; l++)
+				s += T[i*n + l] * X[l*n + j];
+			tmp[i*n + j] = s / k;
+		}
+		T.swap(tmp);
+		for (int i = 0; i < n*n; i++)
+			E[i] += T[i];
+	}
+	for (int isq = 0; isq < nsq; isq++){
+		for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++){
+			double s = 0;
+			for (int l = 0; l < n; l++)
+				s += E[i*n + l] * E[l*n + j];
+			tmp[i*n + j] = s;
+		}
+		for (int i = 0; i < n*n; i++)
+			E[i] = tmp[i];
+	}
+}
+
+ode_expmv::ode_expmv(ode_rhs f, void *params, size_t n, double epsabs, int krylov_dim)
+	: nsteps(0), nmatvec(0), f(f), params(params), n(n), epsabs(epsabs), h(0), m(std::max(krylov_dim, 1))
+{
+	f0 = alloc_aligned_real_array(n); ys = alloc_aligned_real_array(n);
+	fs = alloc_aligned_real_array(n); w = alloc_aligned_real_array(n);
+	V = new double*[m + 1];
+	for (int i = 0; i <= m; i++)
+		V[i] = alloc_aligned_real_array(n);
+	H = new double[(m + 1)*m]();
+	M = new double[(m + 1)*(m + 1)]();
+	E = new double[(m + 1)*(m + 1)]();
+}
+ode_expmv::~ode_expmv(){
+	dealloc_aligned_real_array(f0); dealloc_aligned_real_array(ys);
+	dealloc_aligned_real_array(fs); dealloc_aligned_real_array(w);
+	for (int i = 0; i <= m; i++)
+		dealloc_aligned_real_array(V[i]);
+	delete[] V; delete[] H; delete[] M; delete[] E;
+}
+
+void ode_expmv::matvec(double t, const double y[], const double v[], double av[]){
+	// v is normalized; shifting by the scale of y keeps the difference well above rounding
+	double ynorm = 0;
+	for (size_t i = 0; i < n; i++)
+		ynorm = std::max(ynorm, fabs(y[i]));
+	double sigma = 1. + ynorm;
+	for (size_t i = 0; i < n; i++)
+		ys[i] = y[i] + sigma * v[i];
+	f(t, ys, fs, params); nmatvec++;
+	for (size_t i = 0; i < n; i++)
+		av[i] = (fs[i] - f0[i]) / sigma;
+}
+
+int ode_expmv::arnoldi(double t, const double y[], double beta, double& hnext){
+	for (size_t l = 0; l < n; l++)
+		V[0][l] = f0[l] / beta;
+	for (int i = 0; i < (m + 1)*m; i++) H[i] = 0;
+	hnext = 0;
+	for (int j = 0; j < m; j++){
+		matvec(t, y, V[j], w);
+		// modified Gram-Schmidt
+		for (int i = 0; i <= j; i++){
+			double hij = 0;
+			for (size_t l = 0; l < n; l++)
+				hij += w[l] * V[i][l];
+			H[i*m + j] = hij;
+			for (size_t l = 0; l < n; l++)
+				w[l] -= hij * V[i][l];
+		}
+		double s = 0;
+		for (size_t l = 0; l < n; l++)
+			s += w[l] * w[l];
+		hnext = sqrt(s);
+		H[(j + 1)*m + j] = hnext;
+		if (hnext <= 1e-12 * beta){ hnext = 0; return j + 1; } // happy breakdown: the subspace is invariant, the result is exact
+		for (size_t l = 0; l < n; l++)
+			V[j + 1][l] = w[l] / hnext;
+	}
+	return m;
+}
+
+void ode_expmv::phi1_e1(int k, double hstep, double *c){
+	// exp([[hH, e1], [0, 0]]) = [[exp(hH), phi1(hH) e1], [0, 1]]
+	int k1 = k + 1;
+	for (int i = 0; i < k1*k1; i++) M[i] = 0;
+	for (int i = 0; i < k; i++)
+	for (int j = 0; j < k; j++)
+		M[i*k1 + j] = hstep * H[i*m + j];
+	M[k] = 1; // row 0, column k
+	expm_small(M, k1, E);
+	for (int i = 0; i < k; i++)
+		c[i] = E[i*k1 + k];
+}
+
+int ode_expmv::apply(double *t, double t1, double y[]){
+	std::vector<double> c(m);
+	while (*t < t1){
+		f(*t, y, f0, params);
+		double beta = 0;
+		for (size_t l = 0; l < n; l++)
+			beta += f0[l] * f0[l];
+		beta = sqrt(beta);
+		if (beta == 0){ *t = t1; break; } // stationary
+
+		double hnext;
+		int k = arnoldi(*t, y, beta, hnext);
+		double vmax = 0;
+		if (hnext > 0)
+			for (size_t l = 0; l < n; l++)
+				vmax = std::max(vmax, fabs(V[k][l]));
+
+		// largest step (up to t1) within the error tolerance; the error grows like hstep^(k+1)
+		double hstep = t1 - *t;
+		if (h > 0) hstep = std::min(hstep, 5 * h);
+		for (int itry = 0; ; itry++){
+			phi1_e1(k, hstep, c.data());
+			double err = hstep * beta * hnext * fabs(c[k - 1]) * vmax;
+			if (err <= epsabs) break;
+			if (itry == 50 || hstep <= DBL_EPSILON * std::max(fabs(*t), 1.)) return 1;
+			hstep *= std::max(0.1, 0.9 * pow(epsabs / err, 1. / (k + 1)));
+		}
+
+		for (int i = 0; i < k; i++){
+			double a = hstep * beta * c[i];
+			for (size_t l = 0; l < n; l++)
+				y[l] += a * V[i][l];
+		}
+		bool last = hstep >= t1 - *t;
+		*t = last ? t1 : *t + hstep;
+		if (!last) h = hstep;
+		nsteps++;
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stddef.h>
+#include "ODE_ros2.h"
+
+// exponential propagator for autonomous affine problems dy/dt = f(y) = A y + b
+//   y(t+h) = y + h phi1(h A) f(y),   phi1(z) = (e^z - 1) / z
+// phi1(h A) f(y) is approximated in the Krylov subspace K_m(A, f(y)) built by Arnoldi, so that only products A v are needed;
+// A v = f(y + s v) - f(y) (divided by s) is exact for affine f, so the existing right-hand side (with all its MPI reductions) is the matvec
+// the basis does not depend on h: after one Arnoldi process, the largest h with estimated error max |err| <= epsabs is taken
+// (error estimate of Saad, SIAM J. Numer. Anal. 29, 209 (1992)), so steps can be as long as the output interval
+class ode_expmv{
+public:
+	int nsteps, nmatvec; // statistics since construction
+
+	ode_expmv(ode_rhs f, void *params, size_t n, double epsabs, int krylov_dim = 30);
+	~ode_expmv();
+	double step() const { return h; } // last step size below the output interval, bounds the next trial step
+	void set_step(double h){ this->h = h; }
+
+	// evolve y from *t to t1; returns 0 on success
+	int apply(double *t, double t1, double y[]);
+
+private:
+	ode_rhs f;
+	void *params;
+	size_t n;
+	double epsabs, h;
+	int m; // maximum Krylov subspace dimension
+	double *f0, *ys, *fs, *w;
+	double **V, *H, *M, *E;
+
+	void matvec(double t, const double y[], const double v[], double av[]);
+	int arnoldi(double t, const double y[], double beta, double& hnext); // returns the dimension of the basis
+	void phi1_e1(int k, double hstep, double *c); // c = phi1(hstep H_k) e1
+};
+
+// exp of a small dense n x n matrix (row major) by scaling and squaring of the Taylor series
+void expm_small(const double *A, int n, double *E);
@@ -0,0 +1,188 @@
+#include "ODE_ros2.h"
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include "myarray.h"
+
+ode_ros2::ode_ros2(ode_rhs f, void *params, size_t n, double hstart, double epsabs, bool affine, bool autonomous, int krylov_dim, double krylov_tol)
+	: nsteps(0), nrejects(0), nrhs(0), nkrylov(0),
+	f(f), params(params), n(n), h(hstart), hmin(0), hmax(DBL_MAX), epsabs(epsabs), krylov_tol(krylov_tol), affine(affine), autonomous(autonomous), m(std::max(krylov_dim, 1))
+{
+	f0 = alloc_aligned_real_array(n); k1 = alloc_aligned_real_array(n); k2 = alloc_aligned_real_array(n);
+	ystage = alloc_aligned_real_array(n); fstage = alloc_aligned_real_array(n);
+	yjv = alloc_aligned_real_array(n); fjv = alloc_aligned_real_array(n);
+	r = alloc_aligned_real_array(n); w = alloc_aligned_real_array(n);
+	ft = nullptr; b1 = nullptr;
+	if (!autonomous){ ft = alloc_aligned_real_array(n); b1 = alloc_aligned_real_array(n); }
+	V = new double*[m + 1];
+	for (int i = 0; i <= m; i++)
+		V[i] = alloc_aligned_real_array(n);
+	H = new double[(m + 1)*m]();
+	g = new double[m + 1]();
+	cs = new double[m](); sn = new double[m](); coef = new double[m]();
+}
+ode_ros2::~ode_ros2(){
+	dealloc_aligned_real_array(f0); dealloc_aligned_real_array(k1); dealloc_aligned_real_array(k2);
+	dealloc_aligned_real_array(ystage); dealloc_aligned_real_array(fstage);
+	dealloc_aligned_real_array(yjv); dealloc_aligned_real_array(fjv);
+	dealloc_aligned_real_array(r); dealloc_aligned_real_array(w);
+	if (!autonomous){ dealloc_aligned_real_array(ft); dealloc_aligned_real_array(b1); }
+	for (int i = 0; i <= m; i++)
+		dealloc_aligned_real_array(V[i]);
+	delete[] V; delete[] H; delete[] g; delete[] cs; delete[] sn; delete[] coef;
+}
+
+double ode_ros2::dot(const double a[], const double b[]){
+	double s = 0;
+	for (size_t i = 0; i < n; i++)
+		s += a[i] * b[i];
+	return s;
+}
+double ode_ros2::norm2(const double a[]){
+	return sqrt(dot(a, a));
+}
+
+void ode_ros2::jvp(double t, const double y[], const double fy[], const double v[], double jv[]){
+	double vnorm = norm2(v);
+	if (vnorm == 0){ for (size_t i = 0; i < n; i++) jv[i] = 0; return; }
+	// for affine f any shift is exact; otherwise the usual sqrt(machine precision) scaling
+	double sigma = (affine ? 1. : sqrt(DBL_EPSILON)) * (1. + norm2(y)) / vnorm;
+	for (size_t i = 0; i < n; i++)
+		yjv[i] = y[i] + sigma * v[i];
+	f(t, yjv, fjv, params); nrhs++;
+	for (size_t i = 0; i < n; i++)
+		jv[i] = (fjv[i] - fy[i]) / sigma;
+}
+
+void ode_ros2::apply_matrix(double t, const double y[], const double fy[], double gh, const double v[], double av[]){
+	jvp(t, y, fy, v, av);
+	for (size_t i = 0; i < n; i++)
+		av[i] = v[i] - gh * av[i];
+}
+
+bool ode_ros2::gmres(double t, const double y[], const double fy[], double gh, const double b[], double x[]){
+	const int max_restart = 10;
+	double bnorm = norm2(b);
+	for (size_t i = 0; i < n; i++){ x[i] = 0; r[i] = b[i]; }
+	if (bnorm == 0) return true;
+	double beta = bnorm;
+
+	for (int irestart = 0; irestart < max_restart; irestart++){
+		for (size_t i = 0; i < n; i++)
+			V[0][i] = r[i] / beta;
+		for (int i = 0; i <= m; i++) g[i] = 0;
+		g[0] = beta;
+
+		int jend = 0;
+		bool converged = false;
+		for (int j = 0; j < m; j++){
+			apply_matrix(t, y, fy, gh, V[j], w); nkrylov++;
+			// modified Gram-Schmidt
+			for (int i = 0; i <= j; i++){
+				double hij = dot(w, V[i]);
+				H[i*m + j] = hij;
+				for (size_t l = 0; l < n; l++)
+					w[l] -= hij * V[i][l];
+			}
+			double hnext = norm2(w);
+			H[(j + 1)*m + j] = hnext;
+			if (hnext > 0)
+				for (size_t l = 0; l < n; l++)
+					V[j + 1][l] = w[l] / hnext;
+			// Givens rotations
+			for (int i = 0; i < j; i++){
+				double a = H[i*m + j], c = H[(i + 1)*m + j];
+				H[i*m + j] = cs[i] * a + sn[i] * c;
+				H[(i + 1)*m + j] = -sn[i] * a + cs[i] * c;
+			}
+			double a = H[j*m + j], c = H[(j + 1)*m + j], d = sqrt(a*a + c*c);
+			cs[j] = d == 0 ? 1 : a / d; sn[j] = d == 0 ? 0 : c / d;
+			H[j*m + j] = d; H[(j + 1)*m + j] = 0;
+			g[j + 1] = -sn[j] * g[j]; g[j] = cs[j] * g[j];
+
+			jend = j + 1;
+			if (fabs(g[j + 1]) <= krylov_tol * bnorm || hnext == 0){ converged = true; break; }
+		}
+
+		// x += V coef, H coef = g (upper triangular)
+		for (int i = jend - 1; i >= 0; i--){
+			double s = g[i];
+			for (int l = i + 1; l < jend; l++)
+				s -= H[i*m + l] * coef[l];
+			coef[i] = H[i*m + i] == 0 ? 0 : s / H[i*m + i];
+		}
+		for (int i = 0; i < jend; i++)
+		for (size_t l = 0; l < n; l++)
+			x[l] += coef[i] * V[i][l];
+		if (converged) return true;
+
+		apply_matrix(t, y, fy, gh, x, w);
+		for (size_t l = 0; l < n; l++)
+			r[l] = b[l] - w[l];
+		beta = norm2(r);
+		if (beta <= krylov_tol * bnorm) return true;
+	}
+	return false;
+}
+
+int ode_ros2::apply(double *t, double t1, double y[]){
+	const double gamma = 1. + 1. / sqrt(2.);
+	bool f0_valid = false;
+	double tc = *t; // f may write *t (dm_dynamics::compute sets sdmk->t to the time of each call)
+	while (tc < t1){
+		h = std::min(h, hmax);
+		bool last = h >= t1 - tc;
+		double hstep = last ? t1 - tc : h;
+		if (!f0_valid){
+			f(tc, y, f0, params); nrhs++; f0_valid = true;
+			if (!autonomous){
+				double dt = sqrt(DBL_EPSILON) * std::max(fabs(tc), 1.);
+				f(tc + dt, y, ft, params); nrhs++;
+				for (size_t i = 0; i < n; i++)
+					ft[i] = (ft[i] - f0[i]) / dt;
+			}
+		}
+		double gh = gamma * hstep;
+		bool hsmallest = hstep <= std::max(hmin, DBL_EPSILON * std::max(fabs(tc), 1.));
+
+		if (!autonomous)
+			for (size_t i = 0; i < n; i++)
+				b1[i] = f0[i] + gh * ft[i];
+		bool solved = gmres(tc, y, f0, gh, autonomous ? f0 : b1, k1);
+		if (solved){
+			for (size_t i = 0; i < n; i++)
+				ystage[i] = y[i] + hstep * k1[i];
+			f(tc + hstep, ystage, fstage, params); nrhs++;
+			for (size_t i = 0; i < n; i++)
+				fstage[i] -= 2 * k1[i];
+			if (!autonomous)
+				for (size_t i = 0; i < n; i++)
+					fstage[i] -= gh * ft[i];
+			solved = gmres(tc, y, f0, gh, fstage, k2);
+		}
+		if (!solved){
+			// Krylov solver did not converge; a smaller step makes I - gamma h J better conditioned
+			if (hsmallest){ *t = tc; return 1; }
+			h = std::max(0.5 * hstep, hmin); nrejects++;
+			continue;
+		}
+
+		double ratio = 0;
+		for (size_t i = 0; i < n; i++)
+			ratio = std::max(ratio, fabs(0.5 * hstep * (k1[i] + k2[i])) / epsabs);
+		if (ratio > 1.1 && !hsmallest){
+			h = std::max(hstep * std::max(0.2, 0.9 / sqrt(ratio)), hmin); nrejects++;
+			continue;
+		}
+
+		for (size_t i = 0; i < n; i++)
+			y[i] += hstep * (1.5 * k1[i] + 0.5 * k2[i]);
+		tc = last ? t1 : tc + hstep;
+		f0_valid = false; nsteps++;
+
+		double hnew = ratio < 0.5 ? hstep * std::min(5., 0.9 / sqrt(std::max(ratio, 1e-10))) : hstep;
+		if (!last || hnew < hstep) h = std::min(hnew, hmax);
+	}
+	*t = tc;
+	return 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+
+typedef int (*ode_rhs)(double t, const double y[], double dydt[], void *params); // the same signature as gsl_odeiv2_system.function
+
+// two-stage L-stable Rosenbrock method ROS2 (Verwer et al., SIAM J. Sci. Comput. 20, 1456 (1999)) for stiff problems
+//   (I - gamma h J) k1 = f(t, y) + gamma h df/dt(t, y)
+//   (I - gamma h J) k2 = f(t + h, y + h k1) - 2 k1 - gamma h df/dt(t, y)
+//   y(t+h) = y + 1.5 h k1 + 0.5 h k2,   gamma = 1 + 1/sqrt(2)
+// df/dt is a forward difference in t, one more f per step; it is skipped if f does not depend on t explicitly (autonomous)
+// the linear systems are solved matrix-free by restarted GMRES; J v is a finite difference of f along v,
+// which is exact (up to rounding) if f is affine in y, e.g. with alg.linearize where the scattering term is Lsc (dm - f_eq)
+// local error is 0.5 h (k1 + k2) (difference to the embedded 1st-order solution), controlled by max |err| <= epsabs as in rkf45
+// the state is replicated on all processes and f includes all reductions, so every process takes the same steps
+class ode_ros2{
+public:
+	int nsteps, nrejects, nrhs, nkrylov; // statistics since construction
+
+	ode_ros2(ode_rhs f, void *params, size_t n, double hstart, double epsabs, bool affine, bool autonomous, int krylov_dim = 20, double krylov_tol = 1e-3);
+	~ode_ros2();
+	void set_hmin(double h){ hmin = h; }
+	void set_hmax(double h){ hmax = h; }
+	double step() const { return h; } // next trial step size
+	void set_step(double h){ this->h = h; }
+
+	// evolve y from *t to t1; returns 0 on success; *t is only read at the start and written at the end, f may change it
+	int apply(double *t, double t1, double y[]);
+
+private:
+	ode_rhs f;
+	void *params;
+	size_t n;
+	double h, hmin, hmax, epsabs, krylov_tol;
+	bool affine, autonomous;
+	int m; // Krylov subspace dimension before restart
+	double *f0, *k1, *k2, *ystage, *fstage, *yjv, *fjv, *r, *w, *ft, *b1; // ft, b1: nullptr if autonomous
+	double **V, *H, *g, *cs, *sn, *coef;
+
+	void jvp(double t, const double y[], const double fy[], const double v[], double jv[]);
+	void apply_matrix(double t, const double y[], const double fy[], double gh, const double v[], double av[]); // av = v - gh J v
+	bool gmres(double t, const double y[], const double fy[], double gh, const double b[], double x[]);
+	double dot(const double a[], const double b[]);
+	double norm2(const double a[]);
+};
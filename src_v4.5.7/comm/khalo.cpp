@@ -0,0 +1,69 @@
+#include "khalo.h"
+
+void khalo::init(mymp *mpk, int nk_glob, size_t *k1st, size_t *k2nd, int nkpair_proc){
+	this->mpk = mpk; this->nk_glob = nk_glob;
+	ik0_glob = mpk->varstart; ik1_glob = mpk->varend;
+
+	std::vector<bool> touched(nk_glob, false);
+	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
+		touched[k1st[ikpair_local]] = true;
+		touched[k2nd[ikpair_local]] = true;
+	}
+	ik_halo.clear(); glob2halo.assign(nk_glob, -1);
+	for (int ik = 0; ik < nk_glob; ik++)
+	if (touched[ik]){
+		glob2halo[ik] = ik_halo.size();
+		ik_halo.push_back(ik);
+	}
+	nk_halo = ik_halo.size();
+
+	// ik_halo is sorted and k ownership is contiguous, so rows sent to one owner are contiguous
+	int nprocs = mpk->nprocs;
+	nrow_send.assign(nprocs, 0); nrow_recv.assign(nprocs, 0);
+	for (int ih = 0; ih < nk_halo; ih++)
+		nrow_send[mpk->whose(ik_halo[ih])]++;
+	MPI_Alltoall(nrow_send.data(), 1, MPI_INT, nrow_recv.data(), 1, MPI_INT, MPI_COMM_WORLD);
+
+	std::vector<int> displs_s(nprocs, 0), displs_r(nprocs, 0);
+	for (int i = 1; i < nprocs; i++){
+		displs_s[i] = displs_s[i - 1] + nrow_send[i - 1];
+		displs_r[i] = displs_r[i - 1] + nrow_recv[i - 1];
+	}
+	ik_recv.assign(displs_r[nprocs - 1] + nrow_recv[nprocs - 1], 0);
+	MPI_Alltoallv(ik_halo.data(), nrow_send.data(), displs_s.data(), MPI_INT,
+		ik_recv.data(), nrow_recv.data(), displs_r.data(), MPI_INT, MPI_COMM_WORLD);
+	n2_last = 0;
+
+	size_t nk_halo_max = nk_halo, nrecv_max = ik_recv.size();
+	mpk->allreduce(nk_halo_max, MPI_MAX); mpk->allreduce(nrecv_max, MPI_MAX);
+	if (mpk->ionode) printf("distributed dm: nk_glob = %d, max. halo k points per rank = %lu, max. received rows per rank = %lu\n", nk_glob, nk_halo_max, nrecv_max);
+}
+
+void khalo::set_counts(int n2){
+	if (n2 == n2_last) return;
+	int nprocs = mpk->nprocs;
+	counts_send.resize(nprocs); displs_send.resize(nprocs); counts_recv.resize(nprocs); displs_recv.resize(nprocs);
+	for (int i = 0; i < nprocs; i++){
+		counts_send[i] = nrow_send[i] * n2; counts_recv[i] = nrow_recv[i] * n2;
+		displs_send[i] = i ? displs_send[i - 1] + counts_send[i - 1] : 0;
+		displs_recv[i] = i ? displs_recv[i - 1] + counts_recv[i - 1] : 0;
+	}
+	recvbuf.resize(ik_recv.size() * n2);
+	n2_last = n2;
+}
+
+void khalo::reduce_to_owner(complex **m_halo, complex **m_own, int n2){
+	set_counts(n2);
+	// m_halo is allocated by alloc_array and thus contiguous
+	MPI_Alltoallv(nk_halo > 0 ? m_halo[0] : nullptr, counts_send.data(), displs_send.data(), MPI_DOUBLE_COMPLEX,
+		recvbuf.data(), counts_recv.data(), displs_recv.data(), MPI_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+
+	for (int ik = ik0_glob; ik < ik1_glob; ik++)
+	for (int i = 0; i < n2; i++)
+		m_own[ik - ik0_glob][i] = c0;
+	for (size_t ir = 0; ir < ik_recv.size(); ir++){
+		complex *row = m_own[ik_recv[ir] - ik0_glob], *buf = &recvbuf[ir * n2];
+		for (int i = 0; i < n2; i++)
+			row[i] += buf[i];
+	}
+}
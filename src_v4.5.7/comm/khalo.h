@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "mymp.h"
+#include "constants.h"
+
+// ownership of k-diagonal arrays (size nk_glob x n2) in the distributed-dm mode
+// k points are owned by ranks according to mpk (contiguous ranges);
+// the halo of one rank is the set of k points touched by its local k pairs
+// halo contributions are summed on the owner (reduce_to_owner), owner rows are replicated by mymp::allgather
+class khalo{
+public:
+	mymp *mpk;
+	int nk_glob, nk_halo, ik0_glob, ik1_glob;
+	std::vector<int> ik_halo; // sorted global k indices of halo rows
+	std::vector<int> glob2halo; // -1 if k is not in the halo
+	std::vector<int> ik_recv; // global k index of every row received by the owner, ordered by source rank
+
+	khalo() : mpk(nullptr), nk_glob(0), nk_halo(0), n2_last(0) {}
+	void init(mymp *mpk, int nk_glob, size_t *k1st, size_t *k2nd, int nkpair_proc);
+	inline int ih(int ik_glob){ return glob2halo[ik_glob]; }
+
+	// sum halo rows of all ranks into owned rows; m_own[ik_glob - ik0_glob] for ik0_glob <= ik_glob < ik1_glob
+	// contributions are added in the order of source ranks, so the result does not depend on MPI reduction trees
+	void reduce_to_owner(complex **m_halo, complex **m_own, int n2);
+
+private:
+	std::vector<int> nrow_send, nrow_recv; // in units of rows
+	std::vector<complex> recvbuf;
+	std::vector<int> counts_send, displs_send, counts_recv, displs_recv;
+	int n2_last;
+	void set_counts(int n2);
+};
@@ -1,37 +1,67 @@
 #include "kmap.h"
+#include <gsl/gsl_fft_complex.h>
+
+const uint32_t grid_index::none;
+const size_t grid_index::ngrid_max_dense;
+const size_t grid_index::fill_min_dense;
 
-bool kIndexMap::findk(vector3<> k, size_t& ik){
-	const std::map<vector3<int>, size_t>::iterator iter = the_map.find(ikvec3(k));
-	if (iter != the_map.end()){
-		ik = iter->second;
-		return true;
-	}
-	else return false;
-}
 size_t kIndexMap::k2ik(vector3<> k){ // if you are sure q already exists in qIndexMap
-	return the_map[ikvec3(k)];
+	size_t ik;
+	return the_map.find(ikvec3(k), ik) ? ik : 0;
 }
 
-vector3<int> kIndexMap::ikvec3(vector3<> k){
-	vector3<int> v3 = vector3<int>(0, 0, 0);
-	for (int iDir = 0; iDir < 3; iDir++){
-		double ki = k[iDir] - floor(k[iDir]); //wrapped to [0,1)
-		v3[iDir] = (int)round(kmesh[iDir] * ki);
-		if (v3[iDir] == kmesh[iDir]) v3[iDir] = 0;
+// q = k - k' is on the grid if k and k' are (also for a shifted grid), so the q set is {v : R(v) > 0} with R(v) = sum_g o(g) o(g + v)
+// the cyclic autocorrelation of the occupation o(g) of the grid points, relative to the first k point; R = IFFT(|FFT(o)|^2)
+void qIndexMap::build_grid(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec){
+	size_t ngrid = the_map.dense.size();
+	std::vector<double> data(2 * ngrid, 0.); // complex, packed as GSL expects
+	for (size_t ik = 0; ik < kvec.size(); ik++)
+		data[2 * the_map.offset(iqvec3(kvec[ik] - kvec[0]))] = 1;
+
+	// 3D transform by 1D transforms along each direction
+	size_t stride[3] = { (size_t)kmesh[1] * kmesh[2], (size_t)kmesh[2], 1 };
+	auto fft3 = [&](bool forward){
+		for (int iDir = 0; iDir < 3; iDir++){
+			size_t n = kmesh[iDir];
+			if (n == 1) continue;
+			gsl_fft_complex_wavetable *wavetable = gsl_fft_complex_wavetable_alloc(n);
+			gsl_fft_complex_workspace *workspace = gsl_fft_complex_workspace_alloc(n);
+			for (size_t i = 0; i < ngrid; i++){
+				if ((i / stride[iDir]) % n != 0) continue; // i is the first point of a line along iDir
+				if (forward) gsl_fft_complex_forward(&data[2 * i], stride[iDir], n, wavetable, workspace);
+				else gsl_fft_complex_backward(&data[2 * i], stride[iDir], n, wavetable, workspace);
+			}
+			gsl_fft_complex_wavetable_free(wavetable);
+			gsl_fft_complex_workspace_free(workspace);
+		}
+	};
+	fft3(true);
+	for (size_t i = 0; i < ngrid; i++){
+		data[2 * i] = data[2 * i] * data[2 * i] + data[2 * i + 1] * data[2 * i + 1];
+		data[2 * i + 1] = 0;
 	}
-	return v3;
-}
+	fft3(false); // not normalized: R(v) * ngrid, and R(v) is an integer
 
-size_t qIndexMap::q2iq(vector3<> q){ // if you are sure q already exists in qIndexMap
-	return the_map[iqvec3(q)];
+	size_t iq = 0;
+	for (size_t i = 0; i < ngrid; i++){
+		if (data[2 * i] < 0.5 * ngrid) continue;
+		vector3<int> v(i / stride[0], (i / stride[1]) % kmesh[1], i % kmesh[2]);
+		the_map.insert(v, iq++);
+		qvec.push_back(wrap(vector3<>(v[0] / (double)kmesh[0], v[1] / (double)kmesh[1], v[2] / (double)kmesh[2])));
+	}
 }
 
-vector3<int> qIndexMap::iqvec3(vector3<> q){
-	vector3<int> v3 = vector3<int>(0, 0, 0);
-	for (int iDir = 0; iDir < 3; iDir++){
-		double qi = q[iDir] - floor(q[iDir]); //wrapped to [0,1)
-		v3[iDir] = (int)round(kmesh[iDir] * qi);
-		if (v3[iDir] == kmesh[iDir]) v3[iDir] = 0;
+// the same q set as build_pairs (up to the order), Gamma first and q2iq(qvec[iq]) = iq
+bool qIndexMap::same_as_pairs(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec){
+	qIndexMap ref(kmesh);
+	std::vector<vector3<double>> qref;
+	ref.build_pairs(kvec, qref);
+	if (qref.size() != qvec.size()) return false;
+	if (qvec.size() > 0 && !(iqvec3(qvec[0]) == vector3<int>(0, 0, 0))) return false;
+	for (size_t iq = 0; iq < qvec.size(); iq++){
+		size_t jq;
+		if (!ref.the_map.find(iqvec3(qvec[iq]), jq) || q2iq(qvec[iq]) != iq) return false;
+		if ((qvec[iq] - qref[jq]).length_squared() > 1e-20) return false;
 	}
-	return v3;
-}
\ No newline at end of file
+	return true;
+}
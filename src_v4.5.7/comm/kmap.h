@@ -1,5 +1,8 @@
 #pragma once
 #include <map>
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
 #include "vector3.h"
 #include "myio.h"
 
@@ -14,47 +17,111 @@ static vector3<> wrap(const vector3<>& x, vector3<> center = vector3<>(0,0,0)){
 	return result;
 }
 
-struct kIndexMap{
+// index of points of the kmesh grid, keyed by their integer coordinates in [0, kmesh) (see kIndexMap::ikvec3)
+// a dense array over the whole grid (4 bytes per grid point), so that a lookup is one load, or a std::map (some 50 bytes per point);
+// init(npoint) chooses the dense array if npoint is at least 1/fill_min_dense of the grid and the grid is not larger than ngrid_max_dense
+struct grid_index{
+	static const uint32_t none = UINT32_MAX;
+	static const size_t ngrid_max_dense = (size_t)1 << 24;
+	static const size_t fill_min_dense = 16;
 	vector3<int> kmesh;
+	size_t ngrid;
+	std::vector<uint32_t> dense;
 	std::map<vector3<int>, size_t> the_map;
 
+	grid_index(const vector3<int>& kmesh) : kmesh(kmesh){
+		ngrid = (size_t)std::max(kmesh[0], 0) * std::max(kmesh[1], 0) * std::max(kmesh[2], 0);
+	}
+	void init(size_t npoint){ // npoint: expected number of points, before any insert
+		if (ngrid > 0 && ngrid <= ngrid_max_dense && npoint * fill_min_dense >= ngrid) dense.assign(ngrid, none);
+	}
+	bool is_dense() const { return !dense.empty(); }
+	size_t offset(const vector3<int>& v) const { return ((size_t)v[0] * kmesh[1] + v[1]) * kmesh[2] + v[2]; }
+
+	bool insert(const vector3<int>& v, size_t i){ // as std::map::insert: false and not changed if v is already there
+		if (!is_dense()) return the_map.insert(std::make_pair(v, i)).second;
+		if (i >= none) error_message("index does not fit in 32 bits", "grid_index::insert");
+		uint32_t& entry = dense[offset(v)];
+		if (entry != none) return false;
+		entry = (uint32_t)i;
+		return true;
+	}
+	bool find(const vector3<int>& v, size_t& i) const{
+		if (is_dense()){
+			uint32_t entry = dense[offset(v)];
+			i = entry;
+			return entry != none;
+		}
+		std::map<vector3<int>, size_t>::const_iterator iter = the_map.find(v);
+		if (iter == the_map.end()) return false;
+		i = iter->second;
+		return true;
+	}
+};
+
+// wrapped to [0,1) and rounded to the kmesh grid
+inline vector3<int> grid_vec3(const vector3<int>& kmesh, const vector3<>& k){
+	vector3<int> v3 = vector3<int>(0, 0, 0);
+	for (int iDir = 0; iDir < 3; iDir++){
+		double ki = k[iDir] - floor(k[iDir]); //wrapped to [0,1)
+		v3[iDir] = (int)(kmesh[iDir] * ki + 0.5); // round, as ki >= 0
+		if (v3[iDir] == kmesh[iDir]) v3[iDir] = 0;
+	}
+	return v3;
+}
+
+struct kIndexMap{
+	vector3<int> kmesh;
+	grid_index the_map;
+
 	kIndexMap(vector3<int>& kmesh, std::vector<vector3<double>>& kvec)
-		: kmesh(kmesh), the_map()
+		: kmesh(kmesh), the_map(kmesh)
 	{
-		if (!the_map.empty()) error_message("the_map is not empty", "kIndexMap initialization");
-		std::pair<std::map<vector3<int>, size_t>::iterator, bool> ret;
+		the_map.init(kvec.size());
 		for (size_t ik = 0; ik < kvec.size(); ik++)
-			ret = the_map.insert(std::make_pair(ikvec3(kvec[ik]), ik));
+			the_map.insert(ikvec3(kvec[ik]), ik);
 	}
-	bool findk(vector3<> k, size_t& ik);
+	bool findk(vector3<> k, size_t& ik){ return the_map.find(ikvec3(k), ik); }
 	size_t k2ik(vector3<> k); // if you are sure q already exists in qIndexMap
 
-	vector3<int> ikvec3(vector3<> k);
+	vector3<int> ikvec3(vector3<> k){ return grid_vec3(kmesh, k); }
 };
 
 struct qIndexMap{
 	vector3<int> kmesh;
-	std::map<vector3<int>, size_t> the_map;
+	grid_index the_map;
 
-	qIndexMap(vector3<int>& kmesh) : kmesh(kmesh), the_map()
-	{ if (!the_map.empty()) error_message("the_map is not empty", "qIndexMap initialization"); }
+	qIndexMap(vector3<int>& kmesh) : kmesh(kmesh), the_map(kmesh) {}
 
+	// qvec = all distinct wrap(k - k'), Gamma first
+	// build_grid: if the index is dense (see grid_index; at most nk^2 q vectors), in O(ngrid log ngrid) from the autocorrelation of the occupied grid points;
+	//   q vectors are ordered by their grid coordinates in [0, kmesh); outputs labelled by iq (e.g. vqw_q<iq>.out of the Coulomb model)
+	//   therefore refer to other q vectors than with the k-pair order of build_pairs
+	// build_pairs: O(nk^2) enumeration of k pairs (used for larger grids); q vectors are in the order of their first pair
 	void build(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec){
 		if (qvec.size() > 0) return;
+		the_map.init(std::min(the_map.ngrid, kvec.size() * kvec.size()));
+		if (the_map.is_dense() && kvec.size() > 0) build_grid(kvec, qvec);
+		else build_pairs(kvec, qvec);
+	}
+	void build_grid(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec);
+	bool same_as_pairs(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec); // check of build against build_pairs, O(nk^2)
+	void build_pairs(std::vector<vector3<double>>& kvec, std::vector<vector3<double>>& qvec){
 		size_t iq = 0;
-		std::pair<std::map<vector3<int>, size_t>::iterator, bool> ret;
 		for (size_t ik = 0; ik < kvec.size(); ik++)
 		for (size_t jk = 0; jk < kvec.size(); jk++){
 			vector3<double> q = wrap(kvec[ik] - kvec[jk]);
-			ret = the_map.insert(std::make_pair(iqvec3(q), iq));
-			if (ret.second){
+			if (the_map.insert(iqvec3(q), iq)){
 				qvec.push_back(q);
 				iq++;
 			}
 		}
 	}
 
-	size_t q2iq(vector3<> q); // if you are sure q already exists in qIndexMap
+	size_t q2iq(vector3<> q){ // if you are sure q already exists in qIndexMap
+		size_t iq;
+		return the_map.find(iqvec3(q), iq) ? iq : 0;
+	}
 
-	vector3<int> iqvec3(vector3<> q);
-};
\ No newline at end of file
+	vector3<int> iqvec3(vector3<> q){ return grid_vec3(kmesh, q); }
+};
@@ -0,0 +1,114 @@
+#include "ldbd_file.h"
+#include <string.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myio.h"
+#include "node_shm.h"
+
+bool ldbd_file::use_mmap = false;
+
+// maps the whole file read-only; nullptr for an empty file
+// on failure, stops if fatal, otherwise returns nullptr with ok = false
+static void* map_file(string fname, size_t &nbyte, bool &ok, bool fatal = true){
+	ok = false; nbyte = 0;
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0){
+		if (fatal) error_message("cannot open " + fname, "ldbd_file");
+		return nullptr;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	nbyte = st.st_size;
+	void *map = nullptr;
+	if (nbyte > 0){
+		map = mmap(nullptr, nbyte, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED){
+			close(fd);
+			if (fatal) error_message("cannot map " + fname, "ldbd_file");
+			return nullptr;
+		}
+	}
+	close(fd);
+	ok = true;
+	return map;
+}
+
+ldbd_file::ldbd_file(string fname, bool shared)
+	: fname(fname), nbyte(0), pos(0), fp(nullptr), data(nullptr), map(nullptr), has_win(false)
+{
+	if (!use_mmap){
+		fp = fopen(fname.c_str(), "rb");
+		if (fp == nullptr) error_message("cannot open " + fname, "ldbd_file");
+		nbyte = file_size(fp);
+		return;
+	}
+	bool ok;
+	if (!shared){
+		map = map_file(fname, nbyte, ok);
+		data = (const char*)map;
+		return;
+	}
+
+	MPI_Comm comm = node_shm::comm();
+	int rank_node; MPI_Comm_rank(comm, &rank_node);
+	unsigned long long n[2] = { 0, 1 }; // size, and whether the file could be mapped
+	if (rank_node == 0){
+		map = map_file(fname, nbyte, ok, false);
+		if (map != nullptr) madvise(map, nbyte, MADV_SEQUENTIAL);
+		n[0] = nbyte; n[1] = ok;
+	}
+	// the other processes of the node must not be left waiting in the window allocation
+	MPI_Bcast(n, 2, MPI_UNSIGNED_LONG_LONG, 0, comm);
+	if (!n[1]) error_message("cannot open or map " + fname, "ldbd_file");
+	nbyte = n[0];
+	char *base;
+	MPI_Win_allocate_shared(rank_node == 0 ? (MPI_Aint)nbyte : 0, 1, MPI_INFO_NULL, comm, &base, &win);
+	has_win = true;
+	MPI_Win_fence(0, win);
+	if (rank_node == 0 && nbyte > 0){
+		memcpy(base, map, nbyte);
+		munmap(map, nbyte); map = nullptr;
+	}
+	MPI_Win_fence(0, win);
+	MPI_Aint size_win; int disp_unit;
+	MPI_Win_shared_query(win, 0, &size_win, &disp_unit, &base);
+	data = base;
+}
+
+void ldbd_file::check_size(size_t expect_size, string message) const{
+	if (nbyte != expect_size){
+		printf("file size is %lu while expected size is %lu", nbyte, expect_size);
+		error_message(message);
+	}
+}
+bool ldbd_file::check_size(size_t expect_size) const{
+	return nbyte == expect_size;
+}
+
+void ldbd_file::seek(size_t offset){
+	pos = offset;
+	if (fp != nullptr) fseek_bigfile(fp, offset, 1);
+}
+
+size_t ldbd_file::read(void *buf, size_t size, size_t count){
+	if (fp != nullptr){
+		size_t nread = fread(buf, size, count, fp);
+		pos += nread * size;
+		return nread;
+	}
+	if (pos >= nbyte || size == 0) return 0;
+	size_t nread = std::min(count, (nbyte - pos) / size);
+	memcpy(buf, data + pos, nread * size);
+	pos += nread * size;
+	return nread;
+}
+
+void ldbd_file::close(){
+	if (fp != nullptr) { fclose(fp); fp = nullptr; }
+	if (map != nullptr) { munmap(map, nbyte); map = nullptr; }
+	if (has_win) { MPI_Win_free(&win); has_win = false; }
+	data = nullptr;
+}
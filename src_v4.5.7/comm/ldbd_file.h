@@ -0,0 +1,37 @@
+#pragma once
+#include <mpi.h>
+#include <stdio.h>
+#include <string>
+using namespace std;
+
+// read-only binary input file (ldbd_data/*.bin) with the fseek/fread pattern of the readers
+// stdio mode (default): as before, every process opens the file and freads what it needs
+// mmap mode (alg_mmap_ldbd):
+//   shared (data needed by all processes, e.g. ldbd_smat.bin): collective; one process per node maps the file
+//     and copies it into an MPI shared-memory window, the other processes of the node read from the window,
+//     so that each node reads the file from the filesystem once; the window is freed by close()
+//   not shared (each process needs its own slice, e.g. ldbd_P1_*.bin): every process maps the file and
+//     only the pages of the slices it reads are loaded
+class ldbd_file{
+public:
+	static bool use_mmap;
+
+	ldbd_file(string fname, bool shared = true);
+	~ldbd_file(){ close(); }
+	size_t size() const { return nbyte; }
+	void check_size(size_t expect_size, string message) const;
+	bool check_size(size_t expect_size) const;
+	void seek(size_t offset);
+	void seek(size_t count, size_t size){ seek(count * size); } // as fseek_bigfile
+	size_t read(void *buf, size_t size, size_t count); // as fread, from the current position
+	void close(); // collective in shared mmap mode
+
+private:
+	string fname;
+	size_t nbyte, pos;
+	FILE *fp; // stdio mode
+	const char *data; // mmap mode: the mapped file or the node-shared copy
+	void *map;
+	bool has_win;
+	MPI_Win win;
+};
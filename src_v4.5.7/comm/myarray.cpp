@@ -1,6 +1,7 @@
 #include <myarray.h>
 #include <stdio.h>
 #include <float.h>
+#include <stdlib.h>
 
 void axbyc(double *y, double *x, size_t n, double a, double b, double c){
 	if (b == 0) zeros(y, n);
@@ -133,6 +134,17 @@ double** alloc_real_array(int n1, int n2, double val){
 	}
 	catch (std::bad_alloc& ex){ delete[] ptr; throw ex; }
 }
+double* alloc_aligned_real_array(size_t n, double val){
+	void *p = nullptr;
+	if (posix_memalign(&p, 64, std::max(n, (size_t)1) * sizeof(double)) != 0) throw std::bad_alloc();
+	double *arr = (double*)p;
+	for (size_t i = 0; i < n; i++)
+		arr[i] = val;
+	return arr;
+}
+void dealloc_aligned_real_array(double*& arr){
+	free(arr); arr = nullptr;
+}
 double*** alloc_real_array(int n1, int n2, int n3, double val){
 	double*** arr;
 	if (n1 == 0) return arr;
@@ -37,6 +37,9 @@ void dealloc_real_array(double**& arr);
 void dealloc_real_array(double***& arr);
 void dealloc_array(complex**& arr);
 void dealloc_array(complex***& arr);
+// 1D buffers on the heap aligned to 64 bytes, for large vectors that must not live on the stack (e.g. ODE state)
+double* alloc_aligned_real_array(size_t n, double val = 0.);
+void dealloc_aligned_real_array(double*& arr);
 
 double** trunc_alloccopy_array(double** arr, int n1, int n2_start, int n2_end);
 void trunc_copy_array(double** A, double **B, int n1, int n2_start, int n2_end);
@@ -1,4 +1,5 @@
 #include "mymp.h"
+#include "myio.h"
 
 mymp mpkpair;
 mymp mpkpair2;
@@ -34,6 +35,45 @@ bool mymp::distribute_var(string routine, size_t nvar){
 	MPI_Barrier(MPI_COMM_WORLD);
     return true;
 }
+bool mymp::distribute_var(string routine, const vector<double>& weight){
+	MPI_Barrier(MPI_COMM_WORLD);
+	size_t nvar = weight.size();
+	endArr.clear();
+	for (int iProc = 0; iProc < nprocs; iProc++)
+		endArr.push_back((nvar * (iProc + 1)) / nprocs);
+	double imb_even = imbalance(weight);
+
+	// the end of block iProc is the boundary whose cumulative weight is closest to (iProc + 1)/nprocs of the total
+	vector<double> wcum(nvar + 1, 0.);
+	for (size_t i = 0; i < nvar; i++)
+		wcum[i + 1] = wcum[i] + weight[i];
+	endArr.clear();
+	size_t iend = 0;
+	for (int iProc = 0; iProc < nprocs - 1; iProc++){
+		double target = wcum[nvar] * (iProc + 1) / nprocs;
+		while (iend < nvar && wcum[iend + 1] <= target) iend++;
+		if (iend < nvar && wcum[iend + 1] - target < target - wcum[iend]) iend++;
+		endArr.push_back(iend);
+	}
+	endArr.push_back(nvar);
+	varstart = start(myrank);
+	varend = end(myrank);
+
+	double imb = imbalance(weight);
+	if (ionode) printf("\n%s: %lu tasks distributed by weight, load imbalance (max/mean) = %.3lf (%.3lf with equal counts)\n", routine.c_str(), nvar, imb, imb_even);
+	MPI_Barrier(MPI_COMM_WORLD);
+	return true;
+}
+double mymp::imbalance(const vector<double>& weight){
+	double wmax = 0, wsum = 0;
+	for (int iProc = 0; iProc < nprocs; iProc++){
+		double w = 0;
+		for (size_t i = start(iProc); i < end(iProc); i++)
+			w += weight[i];
+		wmax = std::max(wmax, w); wsum += w;
+	}
+	return wsum > 0 ? wmax * nprocs / wsum : 1.;
+}
 
 void mymp::allreduce(size_t& m, MPI_Op op){
 	MPI_Barrier(MPI_COMM_WORLD);
@@ -57,13 +97,45 @@ void mymp::allreduce(complex *v, int n, MPI_Op op){
 	MPI_Allreduce(MPI_IN_PLACE, v, n, MPI_DOUBLE_COMPLEX, op, MPI_COMM_WORLD);
 }
 
+// arrays from alloc_array are one pool with row pointers, so the whole block is reduced by one MPI call
+// (or a few chunks if n1*n2 exceeds the int count of MPI); other arrays fall back to one call per row
+static bool is_contiguous(void **m, int n1, size_t rowbytes){
+	for (int i = 1; i < n1; i++)
+	if ((char*)m[i] != (char*)m[0] + i * rowbytes) return false;
+	return true;
+}
+static const size_t allreduce_chunk = (size_t)1 << 28;
+
 void mymp::allreduce(complex **m, int n1, int n2, MPI_Op op){
+	if (n1 <= 0 || n2 <= 0) return;
 	MPI_Barrier(MPI_COMM_WORLD);
-	for (int i = 0; i < n1; i++){
+	if (is_contiguous((void**)m, n1, n2 * sizeof(complex))){
+		size_t n = (size_t)n1 * n2;
+		for (size_t i0 = 0; i0 < n; i0 += allreduce_chunk)
+			MPI_Allreduce(MPI_IN_PLACE, m[0] + i0, (int)std::min(allreduce_chunk, n - i0), MPI_DOUBLE_COMPLEX, op, MPI_COMM_WORLD);
+		return;
+	}
+	for (int i = 0; i < n1; i++)
 		MPI_Allreduce(MPI_IN_PLACE, &m[i][0], n2, MPI_DOUBLE_COMPLEX, op, MPI_COMM_WORLD);
-		MPI_Barrier(MPI_COMM_WORLD);
+}
+void mymp::iallreduce(complex **m, int n1, int n2, std::vector<MPI_Request>& reqs, MPI_Op op){
+	if (n1 <= 0 || n2 <= 0) return;
+	if (is_contiguous((void**)m, n1, n2 * sizeof(complex))){
+		size_t n = (size_t)n1 * n2;
+		for (size_t i0 = 0; i0 < n; i0 += allreduce_chunk){
+			reqs.push_back(MPI_REQUEST_NULL);
+			MPI_Iallreduce(MPI_IN_PLACE, m[0] + i0, (int)std::min(allreduce_chunk, n - i0), MPI_DOUBLE_COMPLEX, op, MPI_COMM_WORLD, &reqs.back());
+		}
+		return;
 	}
-	MPI_Barrier(MPI_COMM_WORLD);
+	for (int i = 0; i < n1; i++){
+		reqs.push_back(MPI_REQUEST_NULL);
+		MPI_Iallreduce(MPI_IN_PLACE, &m[i][0], n2, MPI_DOUBLE_COMPLEX, op, MPI_COMM_WORLD, &reqs.back());
+	}
+}
+void mymp::wait(std::vector<MPI_Request>& reqs){
+	if (reqs.size() > 0) MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+	reqs.clear();
 }
 void mymp::allreduce(complex ***a, int n1, int n2, int n3, MPI_Op op){
 	for (int i = 0; i < n1; i++)
@@ -86,21 +158,33 @@ void mymp::allreduce(vector<vector<complex>>& m, MPI_Op op){
 	MPI_Barrier(MPI_COMM_WORLD);
 }
 void mymp::allreduce(double **m, int n1, int n2, MPI_Op op){
+	if (n1 <= 0 || n2 <= 0) return;
 	MPI_Barrier(MPI_COMM_WORLD);
-	//MPI_Allreduce(MPI_IN_PLACE, m[0], n1*n2, MPI_DOUBLE, op, MPI_COMM_WORLD);
-	for (int i = 0; i < n1; i++){
-		MPI_Allreduce(MPI_IN_PLACE, &m[i][0], n2, MPI_DOUBLE, op, MPI_COMM_WORLD);
-		//MPI_Reduce(ionode ? MPI_IN_PLACE : m[i], m[i], n2, MPI_DOUBLE, op, 0, MPI_COMM_WORLD);
-		//MPI_Bcast(m[i], n2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-		MPI_Barrier(MPI_COMM_WORLD);
+	if (is_contiguous((void**)m, n1, n2 * sizeof(double))){
+		size_t n = (size_t)n1 * n2;
+		for (size_t i0 = 0; i0 < n; i0 += allreduce_chunk)
+			MPI_Allreduce(MPI_IN_PLACE, m[0] + i0, (int)std::min(allreduce_chunk, n - i0), MPI_DOUBLE, op, MPI_COMM_WORLD);
+		return;
 	}
-	MPI_Barrier(MPI_COMM_WORLD);
+	for (int i = 0; i < n1; i++)
+		MPI_Allreduce(MPI_IN_PLACE, &m[i][0], n2, MPI_DOUBLE, op, MPI_COMM_WORLD);
 }
 void mymp::allreduce(double ***a, int n1, int n2, int n3, MPI_Op op){
 	for (int i = 0; i < n1; i++)
 		allreduce(a[i], n2, n3, op);
 }
 
+void mymp::allgather(complex **m, int n1, int n2){
+	if (endArr.size() != nprocs || endArr[nprocs - 1] != n1)
+		error_message("allgather requires rows distributed over processes", "mymp::allgather");
+	counts_gather.resize(nprocs); displs_gather.resize(nprocs);
+	for (int i = 0; i < nprocs; i++){
+		counts_gather[i] = (end(i) - start(i)) * n2;
+		displs_gather[i] = start(i) * n2;
+	}
+	MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m[0], counts_gather.data(), displs_gather.data(), MPI_DOUBLE_COMPLEX, MPI_COMM_WORLD);
+}
+
 void mymp::collect(int comm, int nprocs_lv, int varstart, int nvar, int *disp_proc, int *nvar_proc){
 }
 
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <scalar.h>
 #include <string>
+#include <vector>
 #include <mpi.h>
 using namespace std;
 
@@ -57,6 +58,10 @@ public:
 	}
 
 	bool distribute_var(string routine, size_t nvar);
+	// contiguous blocks of about equal total weight, where weight[i] is the estimated cost of task i (the same on all processes);
+	// prints the load imbalance (max/mean of the weight per process) of this and of the equal-count distribution
+	bool distribute_var(string routine, const vector<double>& weight);
+	double imbalance(const vector<double>& weight); //!< max/mean of the weight per process for the current distribution
 	inline size_t start(int iProc){ return iProc ? endArr[iProc - 1] : 0; } //!< Task number that the specified process should start on
 	inline size_t end(int iProc){ return endArr[iProc]; } //!< Task number that the specified process should stop before (non-inclusive)
 	int whose(size_t q){ //!< Which process number should handle this task number
@@ -71,14 +76,20 @@ public:
 	void allreduce(double *v, int n, MPI_Op op = MPI_SUM);
 	void allreduce(complex *v, int n, MPI_Op op = MPI_SUM);
 	void allreduce(complex **m, int n1, int n2, MPI_Op op = MPI_SUM);
+	void iallreduce(complex **m, int n1, int n2, std::vector<MPI_Request>& reqs, MPI_Op op = MPI_SUM); // non-blocking, m is valid after wait(reqs)
+	void wait(std::vector<MPI_Request>& reqs);
 	void allreduce(complex ***m, int n1, int n2, int n3, MPI_Op op = MPI_SUM);
 	void allreduce(vector<vector<double>>& m, MPI_Op op = MPI_SUM);
 	void allreduce(vector<vector<complex>>& m, MPI_Op op = MPI_SUM);
 	void allreduce(double **m, int n1, int n2, MPI_Op op = MPI_SUM);
 	void allreduce(double ***a, int n1, int n2, int n3, MPI_Op op = MPI_SUM);
+	void allgather(complex **m, int n1, int n2); // rows [start(i), end(i)) of rank i are sent to all ranks; m must be contiguous and n1 distributed
 	void collect(int, int, int, int, int*, int*);
 	void varstart_from_nvar(size_t& varstart, size_t nvar);
 	void bcast(size_t*, int, int root = 0);
+
+private:
+	std::vector<int> counts_gather, displs_gather; // kept between allgather calls
 };
 
 extern mymp mpkpair;
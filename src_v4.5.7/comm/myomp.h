@@ -0,0 +1,25 @@
+#pragma once
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// thin wrappers so that the code also compiles without OpenMP
+inline int nthreads_omp(){
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+inline int ithread_omp(){
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+inline void set_nthreads_omp(int n){
+#ifdef _OPENMP
+	if (n > 0) omp_set_num_threads(n);
+#endif
+}
@@ -0,0 +1,85 @@
+#include "node_shm.h"
+#include "myarray.h"
+
+bool node_shm::enabled = false;
+std::map<const void*, MPI_Win> node_shm::wins;
+
+MPI_Comm node_shm::comm(){
+	static MPI_Comm comm = MPI_COMM_NULL;
+	if (comm == MPI_COMM_NULL)
+		MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &comm);
+	return comm;
+}
+
+bool node_shm::writer(){
+	if (!enabled) return true;
+	int rank_node; MPI_Comm_rank(comm(), &rank_node);
+	return rank_node == 0;
+}
+
+void node_shm::sync(){
+	if (!enabled) return;
+	for (auto &w : wins) MPI_Win_sync(w.second);
+	MPI_Barrier(comm());
+	for (auto &w : wins) MPI_Win_sync(w.second);
+}
+
+// the pool is allocated on node rank 0 and zeroed there; the window stays in a passive epoch (lock_all) until it is freed,
+// so that sync() can use MPI_Win_sync
+complex* node_shm::alloc_pool(size_t n, const void* key){
+	MPI_Comm c = comm();
+	int rank_node; MPI_Comm_rank(c, &rank_node);
+	MPI_Win win;
+	complex *base;
+	MPI_Win_allocate_shared(rank_node == 0 ? (MPI_Aint)(n * sizeof(complex)) : 0, sizeof(complex), MPI_INFO_NULL, c, &base, &win);
+	MPI_Aint size_win; int disp_unit;
+	MPI_Win_shared_query(win, 0, &size_win, &disp_unit, &base);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+	if (rank_node == 0)
+		for (size_t i = 0; i < n; i++) base[i] = c0;
+	wins[key] = win;
+	sync();
+	return base;
+}
+void node_shm::free_pool(const void* key){
+	auto it = wins.find(key);
+	if (it == wins.end()) return;
+	MPI_Win_unlock_all(it->second);
+	MPI_Win_free(&it->second);
+	wins.erase(it);
+}
+
+complex** node_shm::alloc_array(int n1, int n2){
+	if (!enabled) return ::alloc_array(n1, n2);
+	complex **arr = new complex*[n1];
+	complex *pool = alloc_pool((size_t)n1 * n2, arr);
+	for (int i1 = 0; i1 < n1; i1++)
+		arr[i1] = &pool[(size_t)i1 * n2];
+	return arr;
+}
+complex*** node_shm::alloc_array(int n1, int n2, int n3){
+	if (!enabled) return ::alloc_array(n1, n2, n3);
+	complex ***arr = new complex**[n1];
+	complex **rows = new complex*[(size_t)n1 * n2];
+	complex *pool = alloc_pool((size_t)n1 * n2 * n3, arr);
+	for (int i1 = 0; i1 < n1; i1++){
+		arr[i1] = &rows[(size_t)i1 * n2];
+		for (int i2 = 0; i2 < n2; i2++)
+			arr[i1][i2] = &pool[((size_t)i1 * n2 + i2) * n3];
+	}
+	return arr;
+}
+
+void node_shm::dealloc_array(complex**& arr){
+	if (arr == nullptr) return;
+	if (!wins.count(arr)) { ::dealloc_array(arr); return; }
+	free_pool(arr);
+	delete[] arr; arr = nullptr;
+}
+void node_shm::dealloc_array(complex***& arr){
+	if (arr == nullptr) return;
+	if (!wins.count(arr)) { ::dealloc_array(arr); return; }
+	free_pool(arr);
+	delete[] arr[0];
+	delete[] arr; arr = nullptr;
+}
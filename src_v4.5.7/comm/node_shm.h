@@ -0,0 +1,29 @@
+#pragma once
+#include <mpi.h>
+#include <map>
+#include <scalar.h>
+using namespace std;
+
+// arrays with one copy per node instead of one per process, in an MPI shared-memory window (MPI_Win_allocate_shared)
+// they have the row pointers of alloc_array, so that they are used as before (arr[ik][...], arr[ik][idir][...])
+// only for data that are the same on all processes and are not changed after they are set (e.g. smat, vmat, Umat):
+// the processes with writer() fill them, then all processes of the node call sync() before reading them
+// if not enabled (alg_shm_arrays = 0, default), the arrays are from alloc_array and every process is a writer
+class node_shm{
+public:
+	static bool enabled;
+
+	static MPI_Comm comm(); // processes of this node
+	static bool writer(); // node rank 0 if enabled
+	static void sync(); // collective on the node if enabled; writes of the writers become visible
+
+	static complex** alloc_array(int n1, int n2);
+	static complex*** alloc_array(int n1, int n2, int n3);
+	static void dealloc_array(complex**& arr);
+	static void dealloc_array(complex***& arr);
+
+private:
+	static std::map<const void*, MPI_Win> wins; // key: row pointers of the array
+	static complex* alloc_pool(size_t n, const void* key);
+	static void free_pool(const void* key);
+};
@@ -0,0 +1,77 @@
+#include "obwriter.h"
+#include <math.h>
+#include <string.h>
+#include "myio.h"
+
+obwriter obw;
+
+void obwriter::init(bool binary, int freq_flush){
+	this->binary = binary;
+	this->freq_flush = freq_flush;
+}
+
+FILE* obwriter::text(const std::string& fname, const std::string& header){
+	auto it = files.find(fname);
+	if (it != files.end()) return it->second;
+	bool is_new = !exists(fname);
+	FILE *fp = fopen(fname.c_str(), "a");
+	if (fp == nullptr) error_message("cannot open " + fname, "obwriter::text");
+	setvbuf(fp, nullptr, _IOFBF, bufsize_text);
+	if (is_new && !header.empty()) fprintf(fp, "%s", header.c_str());
+	files[fname] = fp;
+	return fp;
+}
+
+void obwriter::row(const std::string& fname, const std::string& header, const std::vector<double>& cols){
+	if (!binary){
+		FILE *fp = text(fname, header);
+		if (fabs(cols[0]) < 1e-30) fprintf(fp, " 0.00000000000000e+01");
+		else fprintf(fp, "%21.14le", cols[0]);
+		for (size_t i = 1; i < cols.size(); i++)
+			fprintf(fp, " %21.14le", cols[i]);
+		fprintf(fp, "\n");
+		return;
+	}
+
+	if (fbin == nullptr){
+		string fname_bin = "observables.bin";
+		bool is_new = !exists(fname_bin);
+		fbin = fopen(fname_bin.c_str(), "ab");
+		if (fbin == nullptr) error_message("cannot open " + fname_bin, "obwriter::row");
+		setvbuf(fbin, nullptr, _IOFBF, bufsize_bin);
+		if (is_new) fwrite("DMDOBS01", 1, 8, fbin);
+	}
+	int32_t ncol = (int32_t)cols.size();
+	auto it = series.find(fname);
+	if (it == series.end()){
+		int32_t id = (int32_t)series.size(), tag = -1, lname = (int32_t)fname.size(), lheader = (int32_t)header.size();
+		fwrite(&tag, sizeof(int32_t), 1, fbin); fwrite(&id, sizeof(int32_t), 1, fbin); fwrite(&ncol, sizeof(int32_t), 1, fbin);
+		fwrite(&lname, sizeof(int32_t), 1, fbin); fwrite(fname.data(), 1, lname, fbin);
+		fwrite(&lheader, sizeof(int32_t), 1, fbin); fwrite(header.data(), 1, lheader, fbin);
+		it = series.insert(std::make_pair(fname, id)).first;
+		ncols[fname] = ncol;
+	}
+	else if (ncols[fname] != ncol)
+		error_message("number of columns of " + fname + " changed", "obwriter::row");
+	fwrite(&it->second, sizeof(int32_t), 1, fbin);
+	fwrite(cols.data(), sizeof(double), ncol, fbin);
+}
+
+void obwriter::end_report(){
+	nreport++;
+	if (freq_flush > 0 && nreport % freq_flush == 0) flush();
+}
+
+void obwriter::flush(){
+	for (auto& f : files)
+		fflush(f.second);
+	if (fbin != nullptr) fflush(fbin);
+}
+
+void obwriter::close(){
+	for (auto& f : files)
+		fclose(f.second);
+	files.clear();
+	if (fbin != nullptr){ fclose(fbin); fbin = nullptr; }
+	series.clear(); ncols.clear();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+// output sink of the observable files (only used on ionode)
+// files are opened once, kept open for the whole run and written through large stdio buffers,
+// which are flushed every freq_flush reports, when the run ends and at exit(), e.g. in error_message
+// text mode (default): each time series goes to its own text file, e.g. sz_elec_tot.out, as before
+// binary mode: time series rows go to one container observables.bin, files like fn_elec_ene.out stay text
+//   file header:        char[8] "DMDOBS01"
+//   series declaration: int32 -1, int32 id, int32 ncol, int32 len, char name[len], int32 len, char header[len]
+//   row:                int32 id, double[ncol]
+//   a restarted run appends to the same container and declares its series again;
+//   read_observables.py gives the columns as numpy arrays or exports the text files
+class obwriter{
+public:
+	bool binary;
+	int freq_flush; // in reports; <= 0: flush only at the end of the run
+
+	obwriter() : binary(false), freq_flush(1), nreport(0), fbin(nullptr) {}
+	~obwriter(){ close(); }
+	void init(bool binary, int freq_flush);
+
+	// file opened for appending on first use; header is written only if the file does not exist yet
+	FILE* text(const std::string& fname, const std::string& header = "");
+	// one row of a time series (first column is time); in text mode in the format of the *_tot.out files
+	void row(const std::string& fname, const std::string& header, const std::vector<double>& cols);
+	void end_report(); // called once per report, flushes on the cadence freq_flush
+	void flush();
+	void close();
+
+private:
+	static const size_t bufsize_text = 1 << 16, bufsize_bin = 1 << 20; // bytes
+	int nreport;
+	FILE *fbin;
+	std::map<std::string, FILE*> files;
+	std::map<std::string, int32_t> series; // name -> id in observables.bin
+	std::map<std::string, int32_t> ncols;
+};
+
+extern obwriter obw;
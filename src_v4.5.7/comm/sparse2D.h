@@ -4,6 +4,8 @@
 #include <Random.h>
 #include <myarray.h>
 #include <sparse_matrix.h>
+#include <stdint.h>
+#include <vector>
 using namespace std;
 
 struct sparse2D{
@@ -19,6 +21,18 @@ public:
 	string fnamens, fnames, fnamei, fnamej;
 	FILE *fpns, *fps, *fpi, *fpj;
 	size_t is0; // starting position of s, i and j of smat at the corresponding files in mpi mode
+	// single-file container, used by read_smat if not empty; layout:
+	//   header: char[8] "DMDSPM01", int32 ni, int32 nj, uint64 nk, uint64 ns_tot
+	//   index:  uint64 start[nk + 1], elements of k pair ik are start[ik], ..., start[ik+1]-1
+	//   data:   complex s[ns_tot], int32 i[ns_tot], int32 j[ns_tot]
+	// every process seeks directly to its own k pairs in the index and in each data section
+	string fname_container;
+	static const size_t container_header_size = 32;
+	// seek to byte off + count * size, also beyond 2 GB
+	static void seek_container(FILE *fp, size_t off, size_t count, size_t size){
+		fseek_bigfile(fp, off, 1);
+		fseek_bigfile(fp, count, size, SEEK_CUR);
+	}
 
 	// note that when smat will be updated, in principle, ns_tot, ns_tot_glob, is0 should all be updated
 	// but given that 
@@ -60,6 +74,56 @@ public:
 		get_ns_tot_fromfile();
 		if (mp != nullptr) mp->varstart_from_nvar(is0, ns_tot);
 	}
+	sparse2D(mymp *mp, string fname_container, int ni, int nj)
+		: mp(mp), nk(mp->varend - mp->varstart), ns_tot(0), ni(ni), nj(nj), nij(ni*nj), thrsh(1e-40), is0(0), fname_container(fname_container)
+	{
+		smat = new sparse_mat*[nk];
+		nk_glob = nk;
+		mp->allreduce(nk_glob);
+	}
+	// sparse P with prefix e.g. "ldbd_data/sP1_lindblad": the container <prefix>.bin, or else the legacy files
+	// <prefix>_ns.bin, _s.bin, _i.bin and _j.bin (written by the initialization), which are converted to the container once
+	static sparse2D* read_sparseP(mymp *mp, string prefix, int ni, int nj){
+		sparse2D *sp;
+		if (exists(prefix + ".bin")){
+			sp = new sparse2D(mp, prefix + ".bin", ni, nj);
+			sp->read_smat(false);
+		}
+		else{
+			sp = new sparse2D(mp, prefix + "_ns.bin", prefix + "_s.bin", prefix + "_i.bin", prefix + "_j.bin", ni, nj);
+			sp->read_smat(false);
+			if (mp->ionode) printf("convert %s_{ns,s,i,j}.bin to %s.bin\n", prefix.c_str(), prefix.c_str());
+			sp->write_container(prefix + ".bin");
+		}
+		return sp;
+	}
+	// adds the number of elements of each k pair of the sparse P with this prefix (see read_sparseP) to ns_kpair,
+	// from the container index or <prefix>_ns.bin, without reading the matrices; false if neither file matches
+	static bool add_ns_kpair(string prefix, vector<double>& ns_kpair){
+		size_t nk = ns_kpair.size();
+		if (FILE *fp = fopen((prefix + ".bin").c_str(), "rb")){
+			char magic[8]; int32_t nij_file[2]; uint64_t nk_file, ns_file;
+			bool ok = fread(magic, 1, 8, fp) == 8 && fread(nij_file, sizeof(int32_t), 2, fp) == 2 && fread(&nk_file, sizeof(uint64_t), 1, fp) == 1
+				&& fread(&ns_file, sizeof(uint64_t), 1, fp) == 1 && string(magic, 8) == "DMDSPM01" && nk_file == nk;
+			std::vector<uint64_t> start(nk + 1);
+			ok = ok && fread(start.data(), sizeof(uint64_t), nk + 1, fp) == nk + 1;
+			fclose(fp);
+			if (!ok) return false;
+			for (size_t ik = 0; ik < nk; ik++)
+				ns_kpair[ik] += start[ik + 1] - start[ik];
+			return true;
+		}
+		if (FILE *fp = fopen((prefix + "_ns.bin").c_str(), "rb")){
+			std::vector<int> ns(nk);
+			bool ok = file_size(fp) == nk * sizeof(int) && fread(ns.data(), sizeof(int), nk, fp) == nk;
+			fclose(fp);
+			if (!ok) return false;
+			for (size_t ik = 0; ik < nk; ik++)
+				ns_kpair[ik] += ns[ik];
+			return true;
+		}
+		return false;
+	}
 	~sparse2D(){
 		if ((mp != nullptr && mp->ionode) || mp == nullptr) { printf("destroy this sparse2D object\n"); fflush(stdout); }
 		for (int ik; ik < nk; ik++){ delete smat[ik]; smat[ik] = nullptr;  }
@@ -108,10 +172,43 @@ public:
 	}
 
 	void read_smat(bool do_test = false){
-		for (size_t ik = 0; ik < nk; ik++)
-			read_smat(ik);
+		if (!fname_container.empty())
+			read_container();
+		else
+			for (size_t ik = 0; ik < nk; ik++)
+				read_smat(ik);
 		if (do_test) zgemm_test();
 	}
+	void read_container(){
+		FILE *fp = fopen(fname_container.c_str(), "rb");
+		if (fp == nullptr) error_message("cannot open " + fname_container, "sparse2D::read_container");
+		char magic[8]; int32_t nij_file[2]; uint64_t nk_file, ns_file;
+		if (fread(magic, 1, 8, fp) != 8 || fread(nij_file, sizeof(int32_t), 2, fp) != 2 || fread(&nk_file, sizeof(uint64_t), 1, fp) != 1 || fread(&ns_file, sizeof(uint64_t), 1, fp) != 1
+			|| string(magic, 8) != "DMDSPM01")
+			error_message(fname_container + " is not a sparse matrix container", "sparse2D::read_container");
+		if (nij_file[0] != ni || nij_file[1] != nj || nk_file != nk_glob)
+			error_message(fname_container + " does not match the matrix dimensions or the number of k pairs", "sparse2D::read_container");
+		check_file_size(fp, container_header_size + (nk_file + 1) * sizeof(uint64_t) + ns_file * (sizeof(complex) + 2 * sizeof(int32_t)), fname_container + " size does not match expected size");
+
+		std::vector<uint64_t> start(nk + 1);
+		seek_container(fp, container_header_size, mp->varstart, sizeof(uint64_t));
+		fread(start.data(), sizeof(uint64_t), nk + 1, fp);
+		is0 = start[0]; ns_tot = start[nk] - start[0];
+		for (size_t ik = 0; ik < nk; ik++)
+			smat[ik] = new sparse_mat((int)(start[ik + 1] - start[ik]), false);
+		size_t off_s = container_header_size + (nk_glob + 1) * sizeof(uint64_t);
+		size_t off_i = off_s + ns_file * sizeof(complex), off_j = off_i + ns_file * sizeof(int32_t);
+		seek_container(fp, off_s, is0, sizeof(complex));
+		for (size_t ik = 0; ik < nk; ik++){ smat[ik]->ns = (int)(start[ik + 1] - start[ik]); fread(smat[ik]->s, sizeof(complex), smat[ik]->ns, fp); }
+		seek_container(fp, off_i, is0, sizeof(int32_t));
+		for (size_t ik = 0; ik < nk; ik++) fread(smat[ik]->i, sizeof(int32_t), smat[ik]->ns, fp);
+		seek_container(fp, off_j, is0, sizeof(int32_t));
+		for (size_t ik = 0; ik < nk; ik++) fread(smat[ik]->j, sizeof(int32_t), smat[ik]->ns, fp);
+		fclose(fp);
+		for (size_t ik = 0; ik < nk; ik++)
+			smat[ik]->build_csr(ni);
+		print_ns_tot();
+	}
 	void read_smat(size_t ik){
 		if (ik == 0){
 			fpns = fopen(fnamens.c_str(), "rb");
@@ -127,6 +224,7 @@ public:
 			}
 		}
 		smat[ik] = new sparse_mat(fpns, fps, fpi, fpj);
+		smat[ik]->build_csr(ni);
 		if (ik == nk - 1) { fclose(fpns); fclose(fps); fclose(fpi); fclose(fpj); }
 	}
 
@@ -150,6 +248,58 @@ public:
 		}
 	}
 
+	// collective; all processes write their parts of the container at the same time, into a temporary file that is renamed at the end
+	void write_container(string fname){
+		if (exists(fname)) return; // avoid overwriting
+		uint64_t ns_local = 0, ns0 = 0, ns_glob = 0;
+		for (size_t ik = 0; ik < nk; ik++)
+			ns_local += smat[ik]->ns;
+		MPI_Exscan(&ns_local, &ns0, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+		if (mp->ionode) ns0 = 0; // MPI_Exscan leaves it undefined on rank 0
+		MPI_Allreduce(&ns_local, &ns_glob, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+		size_t off_s = container_header_size + (nk_glob + 1) * sizeof(uint64_t);
+		size_t off_i = off_s + ns_glob * sizeof(complex), off_j = off_i + ns_glob * sizeof(int32_t), size = off_j + ns_glob * sizeof(int32_t);
+		string fname_tmp = fname + ".tmp";
+
+		int ok = 1; // every process learns whether the temporary file could be opened, so that none of them is left waiting
+		if (mp->ionode){
+			FILE *fp = fopen(fname_tmp.c_str(), "wb");
+			if (fp == nullptr) ok = 0;
+			else{
+				int32_t nij_file[2] = { ni, nj }; uint64_t nk_file = nk_glob;
+				fwrite("DMDSPM01", 1, 8, fp); fwrite(nij_file, sizeof(int32_t), 2, fp); fwrite(&nk_file, sizeof(uint64_t), 1, fp); fwrite(&ns_glob, sizeof(uint64_t), 1, fp);
+				seek_container(fp, container_header_size, nk_glob, sizeof(uint64_t));
+				fwrite(&ns_glob, sizeof(uint64_t), 1, fp); // start[nk]
+				seek_container(fp, size - 1, 0, 1); fputc(0, fp); // full size, so that the other processes can write anywhere
+				fclose(fp);
+			}
+		}
+		MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		if (!ok) error_message("cannot create " + fname_tmp, "sparse2D::write_container");
+		if (nk > 0){
+			FILE *fp = fopen(fname_tmp.c_str(), "r+b");
+			if (fp == nullptr) ok = 0;
+			else{
+				std::vector<uint64_t> start(nk);
+				for (size_t ik = 0; ik < nk; ik++)
+					start[ik] = ik == 0 ? ns0 : start[ik - 1] + smat[ik - 1]->ns;
+				seek_container(fp, container_header_size, mp->varstart, sizeof(uint64_t));
+				fwrite(start.data(), sizeof(uint64_t), nk, fp);
+				seek_container(fp, off_s, ns0, sizeof(complex));
+				for (size_t ik = 0; ik < nk; ik++) fwrite(smat[ik]->s, sizeof(complex), smat[ik]->ns, fp);
+				seek_container(fp, off_i, ns0, sizeof(int32_t));
+				for (size_t ik = 0; ik < nk; ik++) fwrite(smat[ik]->i, sizeof(int32_t), smat[ik]->ns, fp);
+				seek_container(fp, off_j, ns0, sizeof(int32_t));
+				for (size_t ik = 0; ik < nk; ik++) fwrite(smat[ik]->j, sizeof(int32_t), smat[ik]->ns, fp);
+				fclose(fp);
+			}
+		}
+		MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+		if (!ok) error_message("cannot write " + fname_tmp, "sparse2D::write_container");
+		if (mp->ionode) rename(fname_tmp.c_str(), fname.c_str());
+		MPI_Barrier(MPI_COMM_WORLD);
+	}
+
 	void zgemm_test(){
 		Random::seed(nk);
 		size_t ik = (size_t)Random::uniformInt(nk);
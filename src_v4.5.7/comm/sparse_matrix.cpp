@@ -1,7 +1,68 @@
 #include <sparse_matrix.h>
+#include <vector>
+#include <algorithm>
+
+void sparse_mat::build_csr(int ni){
+	delete[] rowptr;
+	nrow = ni; rowptr = new int[ni + 1]();
+	bool sorted = true;
+	for (int is = 0; is < ns; is++){
+		rowptr[i[is] + 1]++;
+		if (is > 0 && i[is] < i[is - 1]) sorted = false;
+	}
+	for (int r = 0; r < ni; r++)
+		rowptr[r + 1] += rowptr[r];
+	if (sorted) return;
+	std::vector<int> pos(rowptr, rowptr + ni), i2(ns), j2(ns);
+	std::vector<complex> s2(ns);
+	for (int is = 0; is < ns; is++){
+		int p = pos[i[is]]++;
+		s2[p] = s[is]; i2[p] = i[is]; j2[p] = j[is];
+	}
+	std::copy(s2.begin(), s2.end(), s); std::copy(i2.begin(), i2.end(), i); std::copy(j2.begin(), j2.end(), j);
+}
 
 void sparse_zgemm(complex *c, bool left, sparse_mat *smat, complex *b, int m, int n, int k, complex alpha, complex beta){
-	sparse_zgemm(c, left, smat->s, smat->i, smat->j, smat->ns, b, m, n, k, alpha, beta);
+	// with few elements per row, the per-row overhead of CSR outweighs the scattered writes of COO (c is small and stays in cache)
+	if (left && smat->rowptr != nullptr && smat->nrow == m && smat->ns >= 6 * m)
+		sparse_zgemm_csr(c, smat, b, m, n, alpha, beta);
+	else
+		sparse_zgemm(c, left, smat->s, smat->i, smat->j, smat->ns, b, m, n, k, alpha, beta);
+}
+
+// row by row: every element of c is written once, and for n = 1 (matrix-vector) the row sum is kept in registers
+void sparse_zgemm_csr(complex *c, sparse_mat *smat, complex *b, int m, int n, complex alpha, complex beta){
+	const complex *s = smat->s;
+	const int *col = smat->j, *rowptr = smat->rowptr;
+	bool zero_beta = beta.real() == 0 && beta.imag() == 0, unit = alpha.real() == 1 && alpha.imag() == 0;
+	if (n == 1){
+		const double *bd = (const double*)b;
+		int is = rowptr[0];
+		for (int r = 0; r < m; r++){
+			int is1 = rowptr[r + 1];
+			double re = 0, im = 0;
+			for (; is < is1; is++){
+				double sr = s[is].real(), si = s[is].imag(), br = bd[2 * col[is]], bi = bd[2 * col[is] + 1];
+				re += sr * br - si * bi;
+				im += sr * bi + si * br;
+			}
+			complex sum(re, im);
+			if (!unit) sum = alpha * sum;
+			c[r] = zero_beta ? sum : sum + beta * c[r];
+		}
+		return;
+	}
+	for (int r = 0; r < m; r++){
+		complex *cr = c + (size_t)r*n;
+		if (zero_beta) zeros(cr, n);
+		else for (int j = 0; j < n; j++) cr[j] *= beta;
+		for (int is = rowptr[r]; is < rowptr[r + 1]; is++){
+			complex as = alpha * s[is];
+			const complex *bj = b + (size_t)col[is] * n;
+			for (int j = 0; j < n; j++)
+				cr[j] += as * bj[j];
+		}
+	}
 }
 void sparse_zgemm(complex *c, bool left, complex *s, int *indexi, int *indexj, int ns, complex *b, int m, int n, int k, complex alpha, complex beta){
 	if (beta.real() == 0 && beta.imag() == 0)
@@ -12,38 +73,105 @@ void sparse_zgemm(complex *c, bool left, complex *s, int *indexi, int *indexj, i
 	}
 
 	if (alpha.real() != 0 || alpha.imag() != 0){
-		complex as[ns];
-		if (alpha.real() == 1 && alpha.imag() == 0)
-			for (int is = 0; is < ns; is++)
-				as[is] = s[is];
-		else
-			for (int is = 0; is < ns; is++)
-				as[is] = alpha * s[is];
-
+		// scale the nonzeros on the fly instead of copying them to a stack array of size ns
+		bool unit = alpha.real() == 1 && alpha.imag() == 0;
 		if (left){
 			for (int is = 0; is < ns; is++){
 				int i = indexi[is];
 				int i2 = indexj[is];
+				complex as = unit ? s[is] : alpha * s[is];
 				for (int j = 0; j < n; j++)
-					c[i*n + j] += as[is] * b[i2*n + j];
+					c[i*n + j] += as * b[i2*n + j];
 			}
 		}
 		else{
 			for (int is = 0; is < ns; is++){
 				int i2 = indexi[is];
 				int j = indexj[is];
+				complex as = unit ? s[is] : alpha * s[is];
 				for (int i = 0; i < m; i++)
-					c[i*n + j] += b[i*k + i2] * as[is];
+					c[i*n + j] += b[i*k + i2] * as;
+			}
+		}
+	}
+}
+
+// merge row by row with a column scratch of size nj instead of a dense ni x nj copy of s; the result is sorted by row and column and has row pointers
+static void sparse_merge_dense(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a, complex b, bool keep_pattern, int *pos){
+	if (smat->rowptr == nullptr || smat->nrow != ni) smat->build_csr(ni);
+	std::vector<int> col(nj, -1), rowptr(ni + 1), i2, j2;
+	std::vector<complex> s2;
+	double thr2 = thrsparse * thrsparse; // squared norms avoid a sqrt per element
+	s2.reserve(smat->ns); i2.reserve(smat->ns); j2.reserve(smat->ns);
+	for (int r = 0; r < ni; r++){
+		rowptr[r] = (int)s2.size();
+		for (int is = smat->rowptr[r]; is < smat->rowptr[r + 1]; is++)
+			col[smat->j[is]] = is;
+		for (int c = 0; c < nj; c++){
+			int is = col[c];
+			complex v = a * m[(size_t)r*nj + c];
+			if (is >= 0) v += b * smat->s[is];
+			if (v.norm() > thr2 || (keep_pattern && is >= 0)){
+				if (pos != nullptr && is >= 0) pos[is] = (int)s2.size();
+				s2.push_back(v); i2.push_back(r); j2.push_back(c);
 			}
+			else if (pos != nullptr && is >= 0) pos[is] = -1;
 		}
+		for (int is = smat->rowptr[r]; is < smat->rowptr[r + 1]; is++)
+			col[smat->j[is]] = -1;
 	}
+	rowptr[ni] = (int)s2.size();
+
+	smat->alloc((int)s2.size(), false);
+	smat->ns = (int)s2.size();
+	std::copy(s2.begin(), s2.end(), smat->s); std::copy(i2.begin(), i2.end(), smat->i); std::copy(j2.begin(), j2.end(), smat->j);
+	smat->nrow = ni; smat->rowptr = new int[ni + 1];
+	std::copy(rowptr.begin(), rowptr.end(), smat->rowptr);
 }
 
 void sparse_plus_dense(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a, complex b, complex c){ // s = am + bs + c, default = copy
-	complex *dense = smat->todense(ni, nj);
-	axbyc(dense, m, ni*nj, a, b, c);
-	smat->sparse(dense, ni, nj, thrsparse);
-	delete[] dense;
+	if (c.real() != 0 || c.imag() != 0){ // every element is shifted, s becomes dense anyway
+		complex *dense = smat->todense(ni, nj);
+		axbyc(dense, m, ni*nj, a, b, c);
+		smat->sparse(dense, ni, nj, thrsparse);
+		delete[] dense;
+	}
+	else if (m == nullptr){ // s = bs, scaled and compacted in place
+		int ns = 0;
+		for (int is = 0; is < smat->ns; is++){
+			complex v = b * smat->s[is];
+			if (v.norm() <= thrsparse * thrsparse) continue;
+			smat->s[ns] = v; smat->i[ns] = smat->i[is]; smat->j[ns] = smat->j[is]; ns++;
+		}
+		bool changed = ns < smat->ns;
+		smat->ns = ns;
+		if (changed || smat->rowptr == nullptr) smat->build_csr(ni);
+	}
+	else
+		sparse_merge_dense(smat, thrsparse, m, ni, nj, a, b, false, nullptr);
+}
+
+void sparse_union_plus_dense(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a, complex b, int *pos){
+	sparse_merge_dense(smat, thrsparse, m, ni, nj, a, b, true, pos);
+}
+
+bool sparse_plus_dense_fixed(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a, complex b){
+	if (smat->rowptr == nullptr || smat->nrow != ni) smat->build_csr(ni);
+	std::vector<char> in_pattern(nj, 0);
+	double thr2 = thrsparse * thrsparse / a.norm(); // |am| > thrsparse <=> |m|^2 > thr2
+	for (int r = 0; r < ni; r++){
+		for (int is = smat->rowptr[r]; is < smat->rowptr[r + 1]; is++)
+			in_pattern[smat->j[is]] = 1;
+		bool outside = false;
+		for (int c = 0; c < nj && !outside; c++)
+			if (!in_pattern[c] && m[(size_t)r*nj + c].norm() > thr2) outside = true;
+		for (int is = smat->rowptr[r]; is < smat->rowptr[r + 1]; is++)
+			in_pattern[smat->j[is]] = 0;
+		if (outside) return false;
+	}
+	for (int is = 0; is < smat->ns; is++)
+		smat->s[is] = a * m[(size_t)smat->i[is] * nj + smat->j[is]] + b * smat->s[is];
+	return true;
 }
 
 void sparse_plus_dense(sparse_mat **smat, double thrsparse, complex **m, int nk, int ni, int nj, complex a, complex b, complex c){ // s = am + bs + c, default = copy
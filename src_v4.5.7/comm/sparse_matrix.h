@@ -4,12 +4,15 @@
 #include <myarray.h>
 #include <stdio.h>
 
+// COO storage; when the elements are sorted by row (as produced by sparse()), rowptr makes it also a CSR matrix:
+// the elements of row r are is = rowptr[r], ..., rowptr[r+1]-1, and left multiplications run row by row
 struct sparse_mat{
 	complex *s;
 	int *i, *j;
 	int ns;
+	int *rowptr, nrow; // CSR row pointers of size nrow+1, nullptr if not built
 
-	sparse_mat() : s(nullptr), i(nullptr), j(nullptr), ns(0) {}
+	sparse_mat() : s(nullptr), i(nullptr), j(nullptr), ns(0), rowptr(nullptr), nrow(0) {}
 
 	sparse_mat(int nsmax, bool alloc_only_s) : sparse_mat() {
 		alloc(nsmax, alloc_only_s);
@@ -42,8 +45,8 @@ struct sparse_mat{
 	}
 
 	void del(){
-		delete[] s; delete[] i; delete[] j;
-		s = nullptr; i = nullptr; j = nullptr;
+		delete[] s; delete[] i; delete[] j; delete[] rowptr;
+		s = nullptr; i = nullptr; j = nullptr; rowptr = nullptr; nrow = 0;
  	}
 	~sparse_mat(){ del(); }
 
@@ -57,16 +60,22 @@ struct sparse_mat{
 	void sparse(complex* A, int ni, int nj, double thr=1e-40){
 		get_ns(A, ni*nj, thr);
 		alloc(this->ns, false);
+		nrow = ni; rowptr = new int[ni + 1];
 		int is = 0;
-		for (int i = 0; i < ni; i++)
-		for (int j = 0; j < nj; j++)
-		if (abs(A[i*nj + j]) > thr){
-			this->s[is] = A[i*nj + j];
-			this->i[is] = i;
-			this->j[is] = j;
-			is++;
+		for (int i = 0; i < ni; i++){
+			rowptr[i] = is;
+			for (int j = 0; j < nj; j++)
+			if (abs(A[i*nj + j]) > thr){
+				this->s[is] = A[i*nj + j];
+				this->i[is] = i;
+				this->j[is] = j;
+				is++;
+			}
 		}
+		rowptr[ni] = is;
 	}
+	// row pointers for the COO elements, e.g. read from files; elements are reordered by row if needed (stable)
+	void build_csr(int ni);
 	void get_ns(complex* A, int nij, double thr=1e-40){
 		ns = 0;
 		for (int ij = 0; ij < nij; ij++)
@@ -86,7 +95,13 @@ struct sparse_mat{
 	}
 };
 
-void sparse_zgemm(complex *c, bool left, sparse_mat *smat, complex *b, int m, int n, int k, complex alpha = c1, complex beta = c0);
+void sparse_zgemm(complex *c, bool left, sparse_mat *smat, complex *b, int m, int n, int k, complex alpha = c1, complex beta = c0); // CSR kernel if left, smat->rowptr is built and rows are not too sparse
+void sparse_zgemm_csr(complex *c, sparse_mat *smat, complex *b, int m, int n, complex alpha = c1, complex beta = c0); // c = alpha smat b + beta c, smat is m x k
 void sparse_zgemm(complex *c, bool left, complex *s, int *indexi, int *indexj, int ns, complex *b, int m, int n, int k, complex alpha = c1, complex beta = c0);
 void sparse_plus_dense(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a = c1, complex b = c0, complex c = c0); // s = am + bs + c, default = copy
+// s = am + bs on the union of the pattern of s and the elements |am| > thrsparse; no element of s is dropped, so the pattern only grows
+// pos (size of the old ns, if not nullptr) gives the new position of each old element
+void sparse_union_plus_dense(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a, complex b, int *pos = nullptr);
+// s = am + bs on the fixed pattern of s, only the values change; returns false and leaves s unchanged if am has an element larger than thrsparse outside the pattern
+bool sparse_plus_dense_fixed(sparse_mat *smat, double thrsparse, complex *m, int ni, int nj, complex a = c1, complex b = c0);
 void sparse_plus_dense(sparse_mat **smat, double thrsparse, complex **m, int nk, int ni, int nj, complex a = c1, complex b = c0, complex c = c0); // s = am + bs + c, default = copy
\ No newline at end of file
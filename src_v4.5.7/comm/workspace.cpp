@@ -0,0 +1,47 @@
+#include "workspace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "myio.h"
+
+workspace::~workspace(){
+	for (size_t i = 0; i < slots.size(); i++)
+		free(slots[i].pool);
+}
+
+complex** workspace::array(int islot, int n1, int n2){
+	if (islot < 0 || islot >= ws_nslot) error_message("slot out of range", "workspace::array");
+	slot& s = slots[islot];
+	n1 = std::max(n1, 1); n2 = std::max(n2, 1);
+	size_t n = (size_t)n1 * n2;
+	if (n > s.n){
+		free(s.pool); s.pool = nullptr;
+		void *p = nullptr;
+		if (posix_memalign(&p, alignment, n * sizeof(complex)) != 0)
+			error_message("allocation of " + std::to_string(n * sizeof(complex)) + " bytes failed", "workspace::array");
+		memset(p, 0, n * sizeof(complex));
+		s.pool = (complex*)p; s.n = n;
+		bytes_alloc += n * sizeof(complex);
+	}
+	if ((size_t)n1 > s.rows.size()){
+		s.rows.resize(n1);
+		bytes_alloc += n1 * sizeof(complex*);
+	}
+	for (int i = 0; i < n1; i++)
+		s.rows[i] = s.pool + (size_t)i * n2;
+	return s.rows.data();
+}
+
+void workspace::release(int islot){
+	if (islot < 0 || islot >= ws_nslot) error_message("slot out of range", "workspace::release");
+	slot& s = slots[islot];
+	free(s.pool); s.pool = nullptr; s.n = 0;
+	std::vector<complex*>().swap(s.rows);
+}
+
+size_t workspace::bytes_total() const{
+	size_t b = 0;
+	for (size_t i = 0; i < slots.size(); i++)
+		b += slots[i].n * sizeof(complex) + slots[i].rows.capacity() * sizeof(complex*);
+	return b;
+}
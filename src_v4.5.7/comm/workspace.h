@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <scalar.h>
+
+// reusable scratch buffers of the right-hand side of the master equation
+// a buffer is identified by its slot; it is allocated on first use (or when a larger size is requested)
+// and kept afterwards, so that once the workspace is warmed up (or reserved) no memory is allocated
+enum ws_slot{
+	ws_Pdm, ws_dm1P, ws_dPdm, ws_dm1dP, // e-ph accumulators of k rows (halo rows with alg.distribute_dm)
+	ws_Pdm_own, ws_dm1P_own, ws_dPdm_own, ws_dm1dP_own, // owned rows with alg.distribute_dm
+	ws_ddmdt_halo, // halo rows of ddmdt in linearized e-ph with alg.distribute_dm
+	ws_eq_dm, ws_eq_dm1, ws_eq_ddmdt, // electronphonon::compute_ddmdt_eq
+	ws_nslot
+};
+
+class workspace{
+public:
+	static const size_t alignment = 64; // bytes
+	size_t bytes_alloc; // bytes allocated since the last reset_counter()
+
+	workspace() : bytes_alloc(0), slots(ws_nslot) {}
+	~workspace();
+
+	// contiguous n1 x n2 array: row pointers into one aligned pool; content is not initialized
+	complex** array(int islot, int n1, int n2);
+	void reserve(int islot, int n1, int n2){ array(islot, n1, n2); }
+	void release(int islot); // frees the buffer of a slot that is not needed for a while; array() allocates it again
+	size_t bytes_total() const;
+	void reset_counter(){ bytes_alloc = 0; }
+
+private:
+	struct slot{
+		complex *pool;
+		size_t n;
+		std::vector<complex*> rows;
+		slot() : pool(nullptr), n(0) {}
+	};
+	std::vector<slot> slots;
+};
@@ -18,9 +18,13 @@
 #include <gsl/gsl_roots.h>
 #include <ODE.h>
 #include <mymp.h>
+#include <myomp.h>
 #include <matrix3.h>
 #include <Units.h>
 #include <myio.h>
+#include <obwriter.h>
+#include <ldbd_file.h>
+#include <node_shm.h>
 #include <constants.h>
 #include <myarray.h>
 #include <mymatrix.h>
@@ -42,11 +46,18 @@ public:
 	string picture, scatt, ode_method;
 	bool expt, expt_elight; 
   bool ddmdteq;
+  bool distribute_dm; // k-point ownership with halo exchange for the e-ph accumulators instead of allreduce of full nk_glob arrays; dm and ddmdt stay replicated
+	int nthreads; // OpenMP threads per MPI process
   bool summode, eph_sepr_eh, eph_need_elec, eph_need_hole, sparseP, Pin_is_sparse, set_scv_zero, semiclassical;
 	bool modelH0hasBS; //!< Only used for Models (MoS2, GaAs)
   bool read_Bso, scatt_enable, eph_enable, phenom_relax, only_eimp, only_ee, only_intravalley, only_intervalley, linearize, linearize_dPee;
 	bool use_dmDP_taufm_as_init, DP_beyond_carrierlifetime, positive_tauneq, use_dmDP_in_evolution;
 	double thr_sparseP, mix_tauneq;
+	bool mmap_ldbd; // binary ldbd_data inputs are mapped, shared by the processes of a node; see ldbd_file
+	bool shm_arrays; // read-only k-resolved arrays (smat, lmat, vmat, Umat, dm_eq, ...) have one copy per node; see node_shm
+	bool balance_kpair; // k pairs are distributed by their estimated cost (nonzeros of sparse P) instead of their count
+	double ovlp_cache_mb; bool ovlp_precompute; // overlaps <k|k'> of the scattering models are cached; see ovlp_cache
+	bool rescale_scatt; double rescale_scatt_tol_vq2, rescale_scatt_tol_dm; // e-i and e-e P are rescaled by |vq|^2 when updated; see electronphonon::rescale_scatt
 
 	algorithm(){
 		picture = "interaction";
@@ -69,6 +80,8 @@ public:
 		phenom_relax = false;
 		ode_method = "rkf45";
 		Pin_is_sparse = false;
+		distribute_dm = false;
+		nthreads = 1;
 		sparseP = false;
 		thr_sparseP = 1e-40;
 		set_scv_zero = false;
@@ -80,6 +93,14 @@ public:
 		use_dmDP_in_evolution = false;
 		mix_tauneq = 0.2;
 		read_Bso = false;
+		mmap_ldbd = false;
+		shm_arrays = false;
+		balance_kpair = true;
+		ovlp_cache_mb = 0;
+		ovlp_precompute = false;
+		rescale_scatt = false;
+		rescale_scatt_tol_vq2 = 0.02;
+		rescale_scatt_tol_dm = 0.01;
 	}
 };
 
@@ -43,20 +43,20 @@ void electron::set_H_BS(int ik0_glob, int ik1_glob){
 void electron::set_H_Ez(int ik0_glob, int ik1_glob){ // seems not to work properly
 	if (scale_Ez == 0. || !exists("ldbd_data/ldbd_HEzmat.bin")) return;
 	if (ionode) printf("\nread ldbd_HEzmat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_HEzmat.bin", "rb");
+	ldbd_file fp("ldbd_data/ldbd_HEzmat.bin", false); // each process reads its own k range
 	size_t expected_size = nk * nb_dm*nb_dm * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_HEzmat.bin size does not match expected size");
-	fseek_bigfile(fp, ik0_glob, nb_dm*nb_dm * 2 * sizeof(double));
+	fp.check_size(expected_size, "ldbd_HEzmat.bin size does not match expected size");
+	fp.seek(ik0_glob, nb_dm*nb_dm * 2 * sizeof(double));
 
 	int nk_proc = ik1_glob - ik0_glob;
 	H_Ez = alloc_array(nk_proc, nb_dm*nb_dm);
-	fread(H_Ez[0], 2 * sizeof(double), nk_proc*nb_dm*nb_dm, fp);
+	fp.read(H_Ez[0], 2 * sizeof(double), nk_proc*nb_dm*nb_dm);
 	axbyc(H_Ez, nullptr, nk_proc, nb_dm*nb_dm, c0, complex(scale_Ez, 0));
 	if (ionode){
 		for (int ik = 0; ik < std::min(nk_proc, 10); ik++)
 			printf_complex_mat(H_Ez[ik], nb_dm, nb_dm, "");
 	}
-	fclose(fp);
+	fp.close();
 }
 
 void electron::compute_dm_Bpert_1st(vector3<> Bpert, double t0){
@@ -133,48 +133,48 @@ void electron::read_ldbd_size(){
 }
 void electron::read_ldbd_kvec(){
 	if (ionode) printf("\nread ldbd_kvec(_morek).bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_kvec.bin", "rb");
+	ldbd_file fp("ldbd_data/ldbd_kvec.bin");
 	size_t expected_size = nk * 3 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_kvec.bin size does not match expected size");
+	fp.check_size(expected_size, "ldbd_kvec.bin size does not match expected size");
 	vector3<> ktmp;
 	for (int ik = 0; ik < nk; ik++){
-		fread(&ktmp[0], sizeof(double), 3, fp);
+		fp.read(&ktmp[0], sizeof(double), 3);
 		kvec.push_back(ktmp);
 	}
-	fclose(fp);
+	fp.close();
 
 	nk_morek = 0;
 	if (!exists("ldbd_data/ldbd_kvec_morek.bin")) return;
-	fp = fopen("ldbd_data/ldbd_kvec_morek.bin", "rb");
-	nk_morek = file_size(fp) / (3 * sizeof(double));
+	ldbd_file fpm("ldbd_data/ldbd_kvec_morek.bin");
+	nk_morek = fpm.size() / (3 * sizeof(double));
 	expected_size = nk_morek * 3 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_kvec_morek.bin size does not match expected size");
+	fpm.check_size(expected_size, "ldbd_kvec_morek.bin size does not match expected size");
 	for (int ik = 0; ik < nk_morek; ik++){
-		fread(&ktmp[0], sizeof(double), 3, fp);
+		fpm.read(&ktmp[0], sizeof(double), 3);
 		kvec_morek.push_back(ktmp);
 	}
-	fclose(fp);
+	fpm.close();
 	if (ionode) printf("nk_morek = %d\n", nk_morek);
 }
 void electron::read_ldbd_Bso(){
 	if (ionode) printf("\nread ldbd_Bso.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_Bso.bin", "rb");
+	ldbd_file fp("ldbd_data/ldbd_Bso.bin");
 	size_t expected_size = nk * 3 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_kvec.bin size does not match expected size");
+	fp.check_size(expected_size, "ldbd_kvec.bin size does not match expected size");
 	vector3<> Btmp;
 	for (int ik = 0; ik < nk; ik++){
-		fread(&Btmp[0], sizeof(double), 3, fp);
+		fp.read(&Btmp[0], sizeof(double), 3);
 		Bso.push_back(Btmp);
 	}
-	fclose(fp);
+	fp.close();
 }
 void electron::read_ldbd_ek(){
 	if (ionode) printf("\nread ldbd_ek(_morek).bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_ek.bin", "rb");
+	ldbd_file fp("ldbd_data/ldbd_ek.bin");
 	size_t expected_size = nk*nb*sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_ek.bin size does not match expected size");
+	fp.check_size(expected_size, "ldbd_ek.bin size does not match expected size");
 	for (int ik = 0; ik < nk; ik++)
-		fread(e[ik], sizeof(double), nb, fp);
+		fp.read(e[ik], sizeof(double), nb);
 	if (scissor != 0)
 	for (int ik = 0; ik < nk; ik++)
 		axbyc(&e[ik][nv], nullptr, nb - nv, 0, 1, scissor);
@@ -183,16 +183,16 @@ void electron::read_ldbd_ek(){
 		f[ik][i] = fermi(temperature, mu, e[ik][i]);
 	if (ionode) print_array_atk(e, nb, "ek:");
 	if (ionode) print_array_atk(f, nb, "fk:");
-	fclose(fp);
+	fp.close();
 
 	if (!exists("ldbd_data/ldbd_ek_morek.bin")) return;
 	e_morek = alloc_real_array(nk_morek, nb);
 	f_morek = alloc_real_array(nk_morek, nb);
-	fp = fopen("ldbd_data/ldbd_ek_morek.bin", "rb");
+	ldbd_file fpm("ldbd_data/ldbd_ek_morek.bin");
 	expected_size = nk_morek*nb*sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_ek_morek.bin size does not match expected size");
+	fpm.check_size(expected_size, "ldbd_ek_morek.bin size does not match expected size");
 	for (int ik = 0; ik < nk_morek; ik++)
-		fread(e_morek[ik], sizeof(double), nb, fp);
+		fpm.read(e_morek[ik], sizeof(double), nb);
 	if (scissor != 0)
 	for (int ik = 0; ik < nk_morek; ik++)
 		axbyc(&e_morek[ik][nv], nullptr, nb - nv, 0, 1, scissor);
@@ -203,14 +203,14 @@ void electron::read_ldbd_ek(){
 	if (ionode) print_array_atk(e_morek, nb, "ek_morek:");
 	f_dm_morek = trunc_alloccopy_array(f_morek, nk_morek, bStart_dm, bEnd_dm);
 	if (ionode) print_array_atk(f_morek, nb, "fk_morek:");
-	fclose(fp);
+	fpm.close();
 }
 void electron::read_ldbd_imsig_eph(){
 	if (!exists("ldbd_data/ldbd_imsig.bin")) return;
 	if (ionode) printf("\nread ldbd_imsig.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_imsig.bin", "rb");
+	ldbd_file fp("ldbd_data/ldbd_imsig.bin");
 	size_t expected_size = nk*nb_eph*sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_imsig.bin size does not match expected size");
+	fp.check_size(expected_size, "ldbd_imsig.bin size does not match expected size");
 	
 	imsig_eph_kn = alloc_real_array(nk, nb_eph);
 	imsig_eph_k = new double[nk];
@@ -218,7 +218,7 @@ void electron::read_ldbd_imsig_eph(){
 	double sum_dfde = 0;
 
 	for (int ik = 0; ik < nk; ik++){
-		fread(imsig_eph_kn[ik], sizeof(double), nb_eph, fp);
+		fp.read(imsig_eph_kn[ik], sizeof(double), nb_eph);
 
 		// imSig_k = sum_b imSig_kb * dfde_kb / (sum_b dfde_kb), this is just my definition, not must be right
 		imsig_eph_k[ik] = 0;
@@ -239,7 +239,7 @@ void electron::read_ldbd_imsig_eph(){
 	if (ionode) print_array_atk(imsig_eph_kn, nb_eph, "imsig_eph_kn in Ha:\n");
 	if (ionode) print_array_atk(imsig_eph_k, "imsig_eph_k in Ha:\n");
 	if (ionode) printf("imsig_eph_avg = %lg Ha tau_m_avg = %lg fs\n", imsig_eph_avg, 0.5/imsig_eph_avg/fs);
-	fclose(fp);
+	fp.close();
 }
 void electron::get_kpath(){
 	for (int ipath = 0; ipath < nkpath; ipath++){
@@ -283,20 +283,24 @@ void electron::get_kpath(){
 }
 void electron::read_ldbd_smat(){
 	if (ionode) printf("\nread ldbd_smat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_smat.bin", "rb");
-	size_t expected_size = nk * 3 * nb_dm*nb_dm * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_smat.bin size does not match expected size");
-	for (int ik = 0; ik < nk; ik++)
-	for (int idir = 0; idir < 3; idir++){
-		fread(s[ik][idir], 2 * sizeof(double), nb_dm*nb_dm, fp);
-		if (alg.set_scv_zero){
-			for (int i = 0; i < nv_dm; i++)
-			for (int j = nv_dm; j < nb_dm; j++){
-				s[ik][idir][i*nb_dm + j] = c0;
-				s[ik][idir][j*nb_dm + i] = c0;
+	if (node_shm::writer()){ // s is filled once per node with alg_shm_arrays
+		ldbd_file fp("ldbd_data/ldbd_smat.bin", !node_shm::enabled);
+		size_t expected_size = nk * 3 * nb_dm*nb_dm * 2 * sizeof(double);
+		fp.check_size(expected_size, "ldbd_smat.bin size does not match expected size");
+		for (int ik = 0; ik < nk; ik++)
+		for (int idir = 0; idir < 3; idir++){
+			fp.read(s[ik][idir], 2 * sizeof(double), nb_dm*nb_dm);
+			if (alg.set_scv_zero){
+				for (int i = 0; i < nv_dm; i++)
+				for (int j = nv_dm; j < nb_dm; j++){
+					s[ik][idir][i*nb_dm + j] = c0;
+					s[ik][idir][j*nb_dm + i] = c0;
+				}
 			}
 		}
+		fp.close();
 	}
+	node_shm::sync();
 	if (ionode){
 		if (ik_kpath.size() > 0)
 			for (int ik = 0; ik < ik_kpath.size(); ik++){
@@ -310,24 +314,27 @@ void electron::read_ldbd_smat(){
 			}
 		printf("\n");
 	}
-	fclose(fp);
 }
 void electron::read_ldbd_lmat(){
 	if (ionode) printf("\nread ldbd_lmat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_lmat.bin", "rb");
-	size_t expected_size = nk * 3 * nb_dm*nb_dm * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_lmat.bin size does not match expected size");
-	for (int ik = 0; ik < nk; ik++)
-	for (int idir = 0; idir < 3; idir++){
-		fread(l[ik][idir], 2 * sizeof(double), nb_dm*nb_dm, fp);
-		if (alg.set_scv_zero){
-			for (int i = 0; i < nv_dm; i++)
-			for (int j = nv_dm; j < nb_dm; j++){
-				l[ik][idir][i*nb_dm + j] = c0;
-				l[ik][idir][j*nb_dm + i] = c0;
+	if (node_shm::writer()){ // l is filled once per node with alg_shm_arrays
+		ldbd_file fp("ldbd_data/ldbd_lmat.bin", !node_shm::enabled);
+		size_t expected_size = nk * 3 * nb_dm*nb_dm * 2 * sizeof(double);
+		fp.check_size(expected_size, "ldbd_lmat.bin size does not match expected size");
+		for (int ik = 0; ik < nk; ik++)
+		for (int idir = 0; idir < 3; idir++){
+			fp.read(l[ik][idir], 2 * sizeof(double), nb_dm*nb_dm);
+			if (alg.set_scv_zero){
+				for (int i = 0; i < nv_dm; i++)
+				for (int j = nv_dm; j < nb_dm; j++){
+					l[ik][idir][i*nb_dm + j] = c0;
+					l[ik][idir][j*nb_dm + i] = c0;
+				}
 			}
 		}
+		fp.close();
 	}
+	node_shm::sync();
 	if (ionode){
 		if (ik_kpath.size() > 0)
 		for (int ik = 0; ik < ik_kpath.size(); ik++){
@@ -341,72 +348,83 @@ void electron::read_ldbd_lmat(){
 		}
 		printf("\n");
 	}
-	fclose(fp);
 }
 void electron::read_ldbd_layermat(){
 	if (!print_layer_occ) return;
 	if (ionode) printf("\nread ldbd_layermat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_layermat.bin", "rb");
-	size_t expected_size = nk * nb_dm*nb_dm * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_layermat.bin size does not match expected size");
-	for (int ik = 0; ik < nk; ik++)
-		fread(layer[ik], 2 * sizeof(double), nb_dm*nb_dm, fp);
+	if (node_shm::writer()){
+		ldbd_file fp("ldbd_data/ldbd_layermat.bin", !node_shm::enabled);
+		size_t expected_size = nk * nb_dm*nb_dm * 2 * sizeof(double);
+		fp.check_size(expected_size, "ldbd_layermat.bin size does not match expected size");
+		for (int ik = 0; ik < nk; ik++)
+			fp.read(layer[ik], 2 * sizeof(double), nb_dm*nb_dm);
+		fp.close();
+	}
+	node_shm::sync();
 	if (ionode){
 		for (int ik = 0; ik < std::min(nk, 10); ik++)
 			printf_complex_mat(layer[ik], nb_dm, nb_dm, "");
 	}
-	fclose(fp);
 }
 void electron::read_ldbd_layerspinmat(){
 	if (!print_layer_spin) return;
 	if (ionode) printf("\nread ldbd_layerspinmat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_layerspinmat.bin", "rb");
-	size_t expected_size = nk * nb_dm*nb_dm * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_layerspinmat.bin size does not match expected size");
-	for (int ik = 0; ik < nk; ik++)
-		fread(layerspin[ik], 2 * sizeof(double), nb_dm*nb_dm, fp);
+	if (node_shm::writer()){
+		ldbd_file fp("ldbd_data/ldbd_layerspinmat.bin", !node_shm::enabled);
+		size_t expected_size = nk * nb_dm*nb_dm * 2 * sizeof(double);
+		fp.check_size(expected_size, "ldbd_layerspinmat.bin size does not match expected size");
+		for (int ik = 0; ik < nk; ik++)
+			fp.read(layerspin[ik], 2 * sizeof(double), nb_dm*nb_dm);
+		fp.close();
+	}
+	node_shm::sync();
 	if (ionode){
 		for (int ik = 0; ik < std::min(nk, 10); ik++)
 			printf_complex_mat(layerspin[ik], nb_dm, nb_dm, "");
 	}
-	fclose(fp);
 }
 void electron::read_ldbd_vmat(){
 	if (ionode) printf("\nread ldbd_vmat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_vmat.bin", "rb");
-	size_t expected_size = nk * 3 * nb_dm*nb * 2 * sizeof(double);
-	check_file_size(fp, expected_size, "ldbd_vmat.bin size does not match expected size");
-	for (int ik = 0; ik < nk; ik++)
-	for (int idir = 0; idir < 3; idir++)
-		fread(v[ik][idir], 2 * sizeof(double), nb_dm*nb, fp);
+	if (node_shm::writer()){
+		ldbd_file fp("ldbd_data/ldbd_vmat.bin", !node_shm::enabled);
+		size_t expected_size = nk * 3 * nb_dm*nb * 2 * sizeof(double);
+		fp.check_size(expected_size, "ldbd_vmat.bin size does not match expected size");
+		for (int ik = 0; ik < nk; ik++)
+		for (int idir = 0; idir < 3; idir++)
+			fp.read(v[ik][idir], 2 * sizeof(double), nb_dm*nb);
+		fp.close();
+	}
+	node_shm::sync();
 	//if (ionode){
 	//	for (int ik = 0; ik < std::min(nk, 10); ik++)
 	//		printf_complex_mat(v[ik][2], nb_dm, nb, "");
 	//}
-	fclose(fp);
 }
 void electron::read_ldbd_Umat(){
 	if (ionode) printf("\nread ldbd_Umat.bin:\n");
-	FILE *fp = fopen("ldbd_data/ldbd_Umat.bin", "rb");
-	size_t expected_size = nk * nb_wannier * nb_wannier * 2 * sizeof(double);
-	if (check_file_size(fp, expected_size)){
-		if (ionode) printf("get Ufull[:,%d:%d]\n", bStart_eph + bskipped_wannier, bStart_eph + bskipped_wannier + nb_eph);
-		complex *Ufull = new complex[nb_wannier * nb_wannier];
-		for (int ik = 0; ik < nk; ik++){
-			fread(Ufull, 2 * sizeof(double), nb_wannier * nb_wannier, fp);
-			for (int b1 = 0; b1 < nb_wannier; b1++)
-			for (int b2 = 0; b2 < nb_eph; b2++)
-				U[ik][b1*nb_eph + b2] = Ufull[b1*nb_wannier + b2 + bStart_eph + bskipped_wannier];
+	if (node_shm::writer()){
+		ldbd_file fp("ldbd_data/ldbd_Umat.bin", !node_shm::enabled);
+		size_t expected_size = nk * nb_wannier * nb_wannier * 2 * sizeof(double);
+		if (fp.check_size(expected_size)){
+			if (ionode) printf("get Ufull[:,%d:%d]\n", bStart_eph + bskipped_wannier, bStart_eph + bskipped_wannier + nb_eph);
+			complex *Ufull = new complex[nb_wannier * nb_wannier];
+			for (int ik = 0; ik < nk; ik++){
+				fp.read(Ufull, 2 * sizeof(double), nb_wannier * nb_wannier);
+				for (int b1 = 0; b1 < nb_wannier; b1++)
+				for (int b2 = 0; b2 < nb_eph; b2++)
+					U[ik][b1*nb_eph + b2] = Ufull[b1*nb_wannier + b2 + bStart_eph + bskipped_wannier];
+			}
 		}
+		else{
+			if (ionode) printf("ldbd_Umat.bin does not save full U matrix but a part\n");
+			expected_size = nk * nb_eph * nb_wannier * 2 * sizeof(double);
+			fp.check_size(expected_size, "ldbd_umat.bin size does not match expected size");
+			for (int ik = 0; ik < nk; ik++)
+				fp.read(U[ik], 2 * sizeof(double), nb_wannier * nb_eph);
+		}
+		fp.close();
 	}
-	else{
-		if (ionode) printf("ldbd_Umat.bin does not save full U matrix but a part\n");
-		expected_size = nk * nb_eph * nb_wannier * 2 * sizeof(double);
-		check_file_size(fp, expected_size, "ldbd_umat.bin size does not match expected size");
-		for (int ik = 0; ik < nk; ik++)
-			fread(U[ik], 2 * sizeof(double), nb_wannier * nb_eph, fp);
-	}
-	fclose(fp);
+	node_shm::sync();
 }
 void electron::print_array_atk(double *a, string s, double unit){
 	printf("%s", s.c_str());
@@ -461,12 +479,13 @@ void electron::print_mat_atk(complex **m, int n, string s){
 void electron::alloc_mat(bool alloc_v, bool alloc_U){
 	e = alloc_real_array(nk, nb);
 	f = alloc_real_array(nk, nb);
-	s = alloc_array(nk, 3, nb_dm*nb_dm);
-	if (needL) l = alloc_array(nk, 3, nb_dm*nb_dm);
-	if (alloc_v) v = alloc_array(nk, 3, nb_dm*nb);
-	if (alloc_U) U = alloc_array(nk, nb_wannier * nb_eph);
-	if (print_layer_occ) layer = alloc_array(nk, nb_dm * nb_dm);
-	if (print_layer_spin) layerspin = alloc_array(nk, nb_dm * nb_dm);
+	// the matrices are only read from ldbd_data after this, so with alg_shm_arrays they are shared by the processes of a node
+	s = node_shm::alloc_array(nk, 3, nb_dm*nb_dm);
+	if (needL) l = node_shm::alloc_array(nk, 3, nb_dm*nb_dm);
+	if (alloc_v) v = node_shm::alloc_array(nk, 3, nb_dm*nb);
+	if (alloc_U) U = node_shm::alloc_array(nk, nb_wannier * nb_eph);
+	if (print_layer_occ) layer = node_shm::alloc_array(nk, nb_dm * nb_dm);
+	if (print_layer_spin) layerspin = node_shm::alloc_array(nk, nb_dm * nb_dm);
 }
 
 vector3<> electron::get_kvec(int& ik1, int& ik2, int& ik3){
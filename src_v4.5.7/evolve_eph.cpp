@@ -1,8 +1,9 @@
 #include "ElectronPhonon.h"
 
-void electronphonon::compute_ddmdt_eq(double** f0_expand){
+void electronphonon::compute_ddmdt_eq(double** f0_expand, bool keep_buffers){
 	complex **dm_expand, **dm1_expand, **ddmdt_expand;
-	dm_expand = alloc_array(nk_glob, nb_expand*nb_expand); dm1_expand = alloc_array(nk_glob, nb_expand*nb_expand); ddmdt_expand = alloc_array(nk_glob, nb_expand*nb_expand);
+	dm_expand = ws->array(ws_eq_dm, nk_glob, nb_expand*nb_expand); dm1_expand = ws->array(ws_eq_dm1, nk_glob, nb_expand*nb_expand); ddmdt_expand = ws->array(ws_eq_ddmdt, nk_glob, nb_expand*nb_expand);
+	zeros(dm_expand, nk_glob, nb_expand*nb_expand); zeros(dm1_expand, nk_glob, nb_expand*nb_expand);
 
 	for (int ik = 0; ik < nk_glob; ik++)
 	for (int i = 0; i < nb_expand; i++)
@@ -15,10 +16,39 @@ void electronphonon::compute_ddmdt_eq(double** f0_expand){
 	evolve_driver(0., dm_expand, dm1_expand, ddmdt_expand, true);
 
 	trunc_copy_arraymat(ddmdt_eq, ddmdt_expand, nk_glob, nb_expand, bStart, bEnd);
-	dealloc_array(dm_expand); dealloc_array(dm1_expand); dealloc_array(ddmdt_expand);
+	// the three nk_glob x nb_expand^2 buffers are only needed again at the next update of the scattering models
+	if (!keep_buffers){ ws->release(ws_eq_dm); ws->release(ws_eq_dm1); ws->release(ws_eq_ddmdt); }
+}
+
+void electronphonon::set_expe(double t){
+	if (expe == nullptr){ expe = alloc_array(nk_glob, nb); t_expe = t + 1.; }
+	if (t == t_expe) return;
+	for (int ik = 0; ik < nk_glob; ik++)
+	for (int i = 0; i < nb; i++)
+		expe[ik][i] = cis(e[ik][i] * t);
+	t_expe = t;
+}
+
+void electronphonon::reserve_workspace(){
+	// sizes as requested in evolve and evolve_linear; without scattering neither is called
+	// the buffers of compute_ddmdt_eq are allocated when it is called and released afterwards
+	if (!alg.scatt_enable) return;
+	int nk_acc = alg.distribute_dm ? std::max(kh.nk_halo, 1) : nk_glob;
+	int nk_own = alg.distribute_dm ? std::max(kh.ik1_glob - kh.ik0_glob, 1) : 1;
+	if (!alg.linearize){
+		ws->reserve(ws_Pdm, nk_acc, nb*nb); ws->reserve(ws_dm1P, nk_acc, nb*nb);
+		if (alg.linearize_dPee){ ws->reserve(ws_dPdm, nk_acc, nb*nb); ws->reserve(ws_dm1dP, nk_acc, nb*nb); }
+		if (alg.distribute_dm){
+			ws->reserve(ws_Pdm_own, nk_own, nb*nb); ws->reserve(ws_dm1P_own, nk_own, nb*nb);
+			if (alg.linearize_dPee){ ws->reserve(ws_dPdm_own, nk_own, nb*nb); ws->reserve(ws_dm1dP_own, nk_own, nb*nb); }
+		}
+	}
+	else if (alg.distribute_dm)
+		ws->reserve(ws_ddmdt_halo, nk_acc, nb*nb);
 }
 
 void electronphonon::evolve_driver(double t, complex** dm_expand, complex** dm1_expand, complex** ddmdt_eph_expand, bool compute_eq){
+	if (ws == nullptr) error_message("workspace is not set", "electronphonon::evolve_driver");
 	trunc_copy_arraymat(dm, dm_expand, nk_glob, nb_expand, bStart, bEnd);
 	trunc_copy_arraymat(dm1, dm1_expand, nk_glob, nb_expand, bStart, bEnd);
 	zeros(ddmdt_eph, nk_glob, nb*nb);
@@ -43,161 +73,175 @@ void electronphonon::evolve(double t, complex** dm, complex** dm1, complex** ddm
 	*/
 	// dm1 = 1 - dm;
 	zeros(ddmdt_eph, nk_glob, nb*nb);
-	complex **Pdm = alloc_array(nk_glob, nb*nb), **dm1P = alloc_array(nk_glob, nb*nb), **dPdm, **dm1dP;
-	if (!compute_eq && alg.linearize_dPee) { dPdm = alloc_array(nk_glob, nb*nb); dm1dP = alloc_array(nk_glob, nb*nb); }
-
-	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
-		int ik_glob = k1st[ikpair_local];
-		int ikp_glob = k2nd[ikpair_local];
-		bool isIntravellay = latt->isIntravalley(elec->kvec[ik_glob], elec->kvec[ikp_glob]);
-		if (isIntravellay && alg.only_intervalley) continue;
-		if (!isIntravellay && alg.only_intravalley) continue;
-
-		int iv1 = latt->whichvalley(elec->kvec[ik_glob]);
-		int iv2 = latt->whichvalley(elec->kvec[ikp_glob]);
-		if (iv1 >=0 && iv2 >=0 && !latt->vtrans[iv1][iv2]) continue;
-		//if (ldebug) { fprintf(fp, "\nikpair= %d(%d) ik= %d ikp= %d\n", ikpair_local, nkpair_proc, ik_glob, ikp_glob); fflush(fp); }
-
-		if (alg.summode){
+	if (alg.expt || alg.ddmdteq) set_expe(t);
+	// with alg.distribute_dm, Pdm, dm1P, ... only have rows for the halo k points of the local k pairs
+	int nk_acc = alg.distribute_dm ? std::max(kh.nk_halo, 1) : nk_glob;
+	complex **Pdm = ws->array(ws_Pdm, nk_acc, nb*nb), **dm1P = ws->array(ws_dm1P, nk_acc, nb*nb), **dPdm = nullptr, **dm1dP = nullptr;
+	zeros(Pdm, nk_acc, nb*nb); zeros(dm1P, nk_acc, nb*nb);
+	if (!compute_eq && alg.linearize_dPee) {
+		dPdm = ws->array(ws_dPdm, nk_acc, nb*nb); dm1dP = ws->array(ws_dm1dP, nk_acc, nb*nb);
+		zeros(dPdm, nk_acc, nb*nb); zeros(dm1dP, nk_acc, nb*nb);
+	}
+
+	if (!alg.summode) error_message("!alg.summode not yet implemented");
+	bool need_dPee = !compute_eq && alg.linearize_dPee;
+	int nb4 = (int)std::pow(nb, 4);
+
+	// k pairs are processed in blocks: each k pair writes its contributions to its own slot of kpair_contrib
+	// (in parallel over OpenMP threads), then the slots are added to Pdm, dm1P, ... in k-pair order,
+	// so that the results do not depend on the number of threads
+	for (int ikpair0 = 0; ikpair0 < nkpair_proc; ikpair0 += kpair_block){
+		int ikpair1 = std::min(ikpair0 + kpair_block, nkpair_proc);
+#pragma omp parallel for schedule(dynamic)
+		for (int ikpair_local = ikpair0; ikpair_local < ikpair1; ikpair_local++){
+			kpair_work& w = work[ithread_omp()];
+			// c[0], c[1]: Pdm and dm1P at k; c[2], c[3]: Pdm and dm1P at k'; c[4-7]: the same for dPdm and dm1dP
+			complex **c = kpair_contrib[ikpair_local - ikpair0];
+			kpair_active[ikpair_local - ikpair0] = false;
+			int ik_glob = k1st[ikpair_local];
+			int ikp_glob = k2nd[ikpair_local];
+			bool isIntravellay = latt->isIntravalley(elec->kvec[ik_glob], elec->kvec[ikp_glob]);
+			if (isIntravellay && alg.only_intervalley) continue;
+			if (!isIntravellay && alg.only_intravalley) continue;
+
+			int iv1 = latt->whichvalley(elec->kvec[ik_glob]);
+			int iv2 = latt->whichvalley(elec->kvec[ikp_glob]);
+			if (iv1 >=0 && iv2 >=0 && !latt->vtrans[iv1][iv2]) continue;
+			kpair_active[ikpair_local - ikpair0] = true;
+
 			// ddmdt = pi/Nq Re { (1-dm)^k_n1n3 P1^kk'_n3n2,n4n5 dm^k'_n4n5
 			//                  - (1-dm)^k'_n3n4 P2^kk'_n3n4,n1n5 dm^k_n5n2 + H.C.
 			// P1_n3n2,n4n5 = G^+-_n3n4 * conj(G^+-_n2n5) * nq^+-
 			// P2_n3n4,n1n5 = G^-+_n1n3 * conj(G^-+_n5n4) * nq^+-
-
-			//if (ldebug) { fprintf_complex_mat(fp, P1[ikpair_local], nb*nb, "P1[ikpair_local]:"); fflush(fp); }
-			//if (ldebug) { fprintf_complex_mat(fp, P2[ikpair_local], nb*nb, "P2[ikpair_local]:"); fflush(fp); }
-
 			if (alg.Pin_is_sparse || alg.sparseP){
 				if (!alg.expt){
-					init_sparse_mat(sP1->smat[ikpair_local], smat1_time, true);
-					init_sparse_mat(sP2->smat[ikpair_local], smat2_time, true);
+					init_sparse_mat(sP1->smat[ikpair_local], w.smat1_time, true);
+					init_sparse_mat(sP2->smat[ikpair_local], w.smat2_time, true);
 				}
 				else{
-					compute_sPt(t, e[ik_glob], e[ikp_glob], sP1->smat[ikpair_local], smat1_time, false);
-					compute_sPt(t, e[ik_glob], e[ikp_glob], sP2->smat[ikpair_local], smat2_time, true);
+					compute_sPt(expe[ik_glob], expe[ikp_glob], sP1->smat[ikpair_local], w.smat1_time, false, w);
+					compute_sPt(expe[ik_glob], expe[ikp_glob], sP2->smat[ikpair_local], w.smat2_time, true, w);
 				}
-				sparse_zgemm(Pdm[ik_glob], true, smat1_time, dm[ikp_glob], nb*nb, 1, nb*nb, c1, c1);
-				sparse_zgemm(dm1P[ik_glob], false, smat2_time, dm1[ikp_glob], 1, nb*nb, nb*nb, c1, c1);
+				sparse_zgemm(c[0], true, w.smat1_time, dm[ikp_glob], nb*nb, 1, nb*nb);
+				sparse_zgemm(c[1], false, w.smat2_time, dm1[ikp_glob], 1, nb*nb, nb*nb);
 				if (ik_glob < ikp_glob){
-					init_sparse_mat(smat1_time, sm2_next);
-					init_sparse_mat(smat2_time, sm1_next);
-					conj(smat1_time->s, sm2_next->s, smat1_time->ns);
-					conj(smat2_time->s, sm1_next->s, smat2_time->ns);
-					sparse_zgemm(Pdm[ikp_glob], true, sm1_next, dm[ik_glob], nb*nb, 1, nb*nb, c1, c1);
-					sparse_zgemm(dm1P[ikp_glob], false, sm2_next, dm1[ik_glob], 1, nb*nb, nb*nb, c1, c1);
+					init_sparse_mat(w.smat1_time, w.sm2_next);
+					init_sparse_mat(w.smat2_time, w.sm1_next);
+					conj(w.smat1_time->s, w.sm2_next->s, w.smat1_time->ns);
+					conj(w.smat2_time->s, w.sm1_next->s, w.smat2_time->ns);
+					sparse_zgemm(c[2], true, w.sm1_next, dm[ik_glob], nb*nb, 1, nb*nb);
+					sparse_zgemm(c[3], false, w.sm2_next, dm1[ik_glob], 1, nb*nb, nb*nb);
 				}
 			}
 			else{
 				if (!alg.expt){
-					axbyc(P1t, P1[ikpair_local], (int)std::pow(nb, 4));
-					axbyc(P2t, P2[ikpair_local], (int)std::pow(nb, 4));
+					axbyc(w.P1t, P1[ikpair_local], nb4);
+					axbyc(w.P2t, P2[ikpair_local], nb4);
 				}
 				else{
-					compute_Pt(t, e[ik_glob], e[ikp_glob], P1[ikpair_local], P1t, false);
-					compute_Pt(t, e[ik_glob], e[ikp_glob], P2[ikpair_local], P2t, true);
+					compute_Pt(expe[ik_glob], expe[ikp_glob], P1[ikpair_local], w.P1t, false, w);
+					compute_Pt(expe[ik_glob], expe[ikp_glob], P2[ikpair_local], w.P2t, true, w);
 				}
-				zgemm_interface(Pdm[ik_glob], P1t, dm[ikp_glob], nb*nb, 1, nb*nb, c1, c1);
-				zgemm_interface(dm1P[ik_glob], dm1[ikp_glob], P2t, 1, nb*nb, nb*nb, c1, c1);
+				zgemm_interface(c[0], w.P1t, dm[ikp_glob], nb*nb, 1, nb*nb);
+				zgemm_interface(c[1], dm1[ikp_glob], w.P2t, 1, nb*nb, nb*nb);
 				if (ik_glob < ikp_glob){
-					conj(P1t, P2_next, (int)std::pow(nb, 4));
-					conj(P2t, P1_next, (int)std::pow(nb, 4));
-					zgemm_interface(Pdm[ikp_glob], P1_next, dm[ik_glob], nb*nb, 1, nb*nb, c1, c1);
-					zgemm_interface(dm1P[ikp_glob], dm1[ik_glob], P2_next, 1, nb*nb, nb*nb, c1, c1);
+					conj(w.P1t, w.P2_next, nb4);
+					conj(w.P2t, w.P1_next, nb4);
+					zgemm_interface(c[2], w.P1_next, dm[ik_glob], nb*nb, 1, nb*nb);
+					zgemm_interface(c[3], dm1[ik_glob], w.P2_next, 1, nb*nb, nb*nb);
 				}
-				if (!compute_eq && alg.linearize_dPee){
+				if (need_dPee){
+					zeros(c[4], nb*nb); zeros(c[5], nb*nb);
 					for (int i1 = 0; i1 < nb; i1++)
 					for (int i2 = 0; i2 < nb; i2++){
 						int i12 = i1*nb + i2, n12 = i12*nb*nb;
 						for (int i3 = 0; i3 < nb; i3++){
-							dPdm[ik_glob][i12] += dP1ee[ikpair_local][n12 + i3*nb + i3] * f_eq[ikp_glob][i3];
-							dm1dP[ik_glob][i12] += f1_eq[ikp_glob][i3] * dP2ee[ikpair_local][(i3*nb + i3)*nb*nb + i12];
+							c[4][i12] += dP1ee[ikpair_local][n12 + i3*nb + i3] * f_eq[ikp_glob][i3];
+							c[5][i12] += f1_eq[ikp_glob][i3] * dP2ee[ikpair_local][(i3*nb + i3)*nb*nb + i12];
 						}
 					}
 					if (ik_glob < ikp_glob){
-						conj(dP1ee[ikpair_local], P2_next, (int)std::pow(nb, 4));
-						conj(dP2ee[ikpair_local], P1_next, (int)std::pow(nb, 4));
+						zeros(c[6], nb*nb); zeros(c[7], nb*nb);
+						conj(dP1ee[ikpair_local], w.P2_next, nb4);
+						conj(dP2ee[ikpair_local], w.P1_next, nb4);
 						for (int i1 = 0; i1 < nb; i1++)
 						for (int i2 = 0; i2 < nb; i2++){
 							int i12 = i1*nb + i2, n12 = i12*nb*nb;
 							for (int i3 = 0; i3 < nb; i3++){
-								dPdm[ikp_glob][i12] += P1_next[n12 + i3*nb + i3] * f_eq[ik_glob][i3];
-								dm1dP[ikp_glob][i12] += f1_eq[ik_glob][i3] * P2_next[(i3*nb + i3)*nb*nb + i12];
+								c[6][i12] += w.P1_next[n12 + i3*nb + i3] * f_eq[ik_glob][i3];
+								c[7][i12] += f1_eq[ik_glob][i3] * w.P2_next[(i3*nb + i3)*nb*nb + i12];
 							}
 						}
 					}
 				}
 			}
 		}
-		else{
-			//compute_ddmdt(dm[ik_glob], dm[ikp_glob], dm1[ik_glob], dm1[ikp_glob], App[ikpair_local], Amm[ikpair_local], Apm[ikpair_local], Amp[ikpair_local], ddmdt_eph[ik_glob]);
-			error_message("!alg.summode not yet implemented");
+
+		for (int ikpair_local = ikpair0; ikpair_local < ikpair1; ikpair_local++){
+			if (!kpair_active[ikpair_local - ikpair0]) continue;
+			complex **c = kpair_contrib[ikpair_local - ikpair0];
+			int ik_glob = k1st[ikpair_local];
+			int ikp_glob = k2nd[ikpair_local];
+			int ir = alg.distribute_dm ? kh.ih(ik_glob) : ik_glob, irp = alg.distribute_dm ? kh.ih(ikp_glob) : ikp_glob; // rows of Pdm, dm1P, ...
+			axbyc(Pdm[ir], c[0], nb*nb, c1, c1); axbyc(dm1P[ir], c[1], nb*nb, c1, c1);
+			if (ik_glob < ikp_glob){ axbyc(Pdm[irp], c[2], nb*nb, c1, c1); axbyc(dm1P[irp], c[3], nb*nb, c1, c1); }
+			if (need_dPee && !alg.Pin_is_sparse && !alg.sparseP){
+				axbyc(dPdm[ir], c[4], nb*nb, c1, c1); axbyc(dm1dP[ir], c[5], nb*nb, c1, c1);
+				if (ik_glob < ikp_glob){ axbyc(dPdm[irp], c[6], nb*nb, c1, c1); axbyc(dm1dP[irp], c[7], nb*nb, c1, c1); }
+			}
 		}
 	}
 
-	mp->allreduce(Pdm, nk_glob, nb*nb, MPI_SUM); mp->allreduce(dm1P, nk_glob, nb*nb, MPI_SUM);
-	if (!compute_eq && alg.linearize_dPee){ mp->allreduce(dPdm, nk_glob, nb*nb, MPI_SUM); mp->allreduce(dm1dP, nk_glob, nb*nb, MPI_SUM); }
-
-	for (int ik_glob = 0; ik_glob < nk_glob; ik_glob++){
-		zeros(ddmdt_contrib, nb*nb);
-		zhemm_interface(ddmdt_contrib, true, dm1[ik_glob], Pdm[ik_glob], nb);
-		zhemm_interface(ddmdt_contrib, false, dm[ik_glob], dm1P[ik_glob], nb, cm1, c1);
+	// k range of ddmdt_eph computed by this process
+	int ik0 = 0, ik1 = nk_glob;
+	if (!alg.distribute_dm){
+		// all reductions are in flight together
+		mp->iallreduce(Pdm, nk_glob, nb*nb, reqs); mp->iallreduce(dm1P, nk_glob, nb*nb, reqs);
+		if (!compute_eq && alg.linearize_dPee){ mp->iallreduce(dPdm, nk_glob, nb*nb, reqs); mp->iallreduce(dm1dP, nk_glob, nb*nb, reqs); }
+		mp->wait(reqs);
+	}
+	else{
+		// halo rows are summed on the owners of k points; afterwards Pdm, ... have rows ik_glob - ik0
+		ik0 = kh.ik0_glob; ik1 = kh.ik1_glob;
+		int nk_own = std::max(ik1 - ik0, 1);
+		complex **Pdm_own = ws->array(ws_Pdm_own, nk_own, nb*nb), **dm1P_own = ws->array(ws_dm1P_own, nk_own, nb*nb);
+		kh.reduce_to_owner(Pdm, Pdm_own, nb*nb); kh.reduce_to_owner(dm1P, dm1P_own, nb*nb);
+		Pdm = Pdm_own; dm1P = dm1P_own;
 		if (!compute_eq && alg.linearize_dPee){
+			complex **dPdm_own = ws->array(ws_dPdm_own, nk_own, nb*nb), **dm1dP_own = ws->array(ws_dm1dP_own, nk_own, nb*nb);
+			kh.reduce_to_owner(dPdm, dPdm_own, nb*nb); kh.reduce_to_owner(dm1dP, dm1dP_own, nb*nb);
+			dPdm = dPdm_own; dm1dP = dm1dP_own;
+		}
+	}
+
+#pragma omp parallel for
+	for (int ik_glob = ik0; ik_glob < ik1; ik_glob++){
+		int ir = ik_glob - ik0;
+		complex *contrib = work[ithread_omp()].contrib;
+		zeros(contrib, nb*nb);
+		zhemm_interface(contrib, true, dm1[ik_glob], Pdm[ir], nb);
+		zhemm_interface(contrib, false, dm[ik_glob], dm1P[ir], nb, cm1, c1);
+		if (need_dPee){
 			for (int i = 0; i < nb; i++)
 			for (int j = 0; j < nb; j++)
-				ddmdt_contrib[i*nb + j] += (f1_eq[ik_glob][i] * dPdm[ik_glob][i*nb + j] - dm1dP[ik_glob][i*nb + j] * f_eq[ik_glob][j]) * cis((e[ik_glob][i] - e[ik_glob][j])*t);
+				contrib[i*nb + j] += (f1_eq[ik_glob][i] * dPdm[ir][i*nb + j] - dm1dP[ir][i*nb + j] * f_eq[ik_glob][j]) * expe[ik_glob][i] * conj(expe[ik_glob][j]);
 		}
 		for (int i = 0; i < nb; i++)
 		for (int j = 0; j < nb; j++)
-			ddmdt_eph[ik_glob][i*nb + j] = (prefac_eph*0.5) * (ddmdt_contrib[i*nb + j] + conj(ddmdt_contrib[j*nb + i]));
+			ddmdt_eph[ik_glob][i*nb + j] = (prefac_eph*0.5) * (contrib[i*nb + j] + conj(contrib[j*nb + i]));
 	}
 
 	if (!compute_eq && alg.ddmdteq){
-		for (int ik_glob = 0; ik_glob < nk_glob; ik_glob++)
+		for (int ik_glob = ik0; ik_glob < ik1; ik_glob++)
 		for (int i = 0; i < nb; i++)
 		for (int j = 0; j < nb; j++)
 		if (i==j || alg.picture == "schrodinger")
 			ddmdt_eph[ik_glob][i*nb + j] -= ddmdt_eq[ik_glob][i*nb + j];
 		else
-			ddmdt_eph[ik_glob][i*nb + j] -= (ddmdt_eq[ik_glob][i*nb + j] * cis((e[ik_glob][i] - e[ik_glob][j])*t));
+			ddmdt_eph[ik_glob][i*nb + j] -= (ddmdt_eq[ik_glob][i*nb + j] * expe[ik_glob][i] * conj(expe[ik_glob][j]));
 	}
 
-	dealloc_array(Pdm); dealloc_array(dm1P); if (!compute_eq && alg.linearize_dPee){ dealloc_array(dPdm); dealloc_array(dm1dP); }
-	//if (ldebug) fclose(fp);
-}
+	if (alg.distribute_dm) mpk.allgather(ddmdt_eph, nk_glob, nb*nb);
 
-// suppose phase is zero at t=0.0
-inline void electronphonon::compute_Pt(double t, double *ek, double *ekp, complex *P, complex *Pt, bool minus){
-	// P1_n3n2,n4n5 = G^+-_n3n4 * conj(G^+-_n2n5) * nq^+-
-	// P1_n3n2,n4n5(t) = P1_n3n2,n4n5 * exp[i*t*(e^k_n3 - e^kp_n4 - e^k_n2 + e^kp_n5)]
-	// P2_n3n4,n1n5 = G^-+_n1n3 * conj(G^-+_n5n4) * nq^+-
-	// P2_n3n4,n1n5(t) = P2_n3n4,n1n5 * exp[i*t*(e^k_n1 - e^kp_n3 - e^k_n5 + e^kp_n4)]
-	for (int i1 = 0; i1 < nb; i1++){
-		int n1 = i1*nb;
-		for (int i2 = 0; i2 < nb; i2++){
-			int n12 = (n1 + i2)*nb;
-			for (int i3 = 0; i3 < nb; i3++){
-				int n123 = (n12 + i3)*nb;
-				for (int i4 = 0; i4 < nb; i4++){
-					if (!minus) Pt[n123 + i4] = P[n123 + i4] * cis((ek[i1] - ekp[i3] - ek[i2] + ekp[i4])*t);
-					else Pt[n123 + i4] = P[n123 + i4] * cis((ek[i3] - ekp[i1] - ek[i4] + ekp[i2])*t);
-				}
-			}
-		}
-	}
-}
-inline void electronphonon::init_sparse_mat(sparse_mat *sin, sparse_mat *sout, bool copy_elem){
-	sout->i = sin->i; sout->j = sin->j; sout->ns = sin->ns; // sout->s has been allocated and will be rewritten, we should not set sout->s = sin->s
-	if (copy_elem)
-	for (int is = 0; is < sin->ns; is++)
-		sout->s[is] = sin->s[is];
-}
-inline void electronphonon::compute_sPt(double t, double *ek, double *ekp, sparse_mat *sm, sparse_mat *smt, bool minus){
-	init_sparse_mat(sm, smt);
-	// notice that P has four band indeces
-	for (int is = 0; is < sm->ns; is++){
-		int ind1 = sm->i[is], ind2 = sm->j[is],
-			i = ij2i[ind1], j = ij2j[ind1], k = ij2i[ind2], l = ij2j[ind2];
-		if (!minus) smt->s[is] = sm->s[is] * cis((ek[i] - ekp[k] - ek[j] + ekp[l])*t);
-		else smt->s[is] = sm->s[is] * cis((ek[k] - ekp[i] - ek[l] + ekp[j])*t);
-	}
+	//if (ldebug) fclose(fp);
 }
@@ -14,60 +14,85 @@ void electronphonon::evolve_linear(double t, complex** dm, complex** ddmdt_eph){
 	for (int i = 0; i < nb; i++)
 		dm[ik_glob][i*nb + i] -= f_eq[ik_glob][i]; // dm is a temporary matrix, it is fine to change it
 	zeros(ddmdt_eph, nk_glob, nb*nb);
+	if (alg.expt) set_expe(t);
+	// with alg.distribute_dm, contributions are accumulated on halo rows and summed on the owners of k points
+	complex **ddmdt_acc = ddmdt_eph;
+	if (alg.distribute_dm){
+		ddmdt_acc = ws->array(ws_ddmdt_halo, kh.nk_halo, nb*nb);
+		zeros(ddmdt_acc, std::max(kh.nk_halo, 1), nb*nb);
+	}
 
-	for (int ikpair_local = 0; ikpair_local < nkpair_proc; ikpair_local++){
-		int ik_glob = k1st[ikpair_local];
-		int ikp_glob = k2nd[ikpair_local];
-		bool isIntravellay = latt->isIntravalley(elec->kvec[ik_glob], elec->kvec[ikp_glob]);
-		if (isIntravellay && alg.only_intervalley) continue;
-		if (!isIntravellay && alg.only_intravalley) continue;
-		//if (ldebug) { fprintf(fp, "\nikpair= %d(%d) ik= %d ikp= %d\n", ikpair_local, nkpair_proc, ik_glob, ikp_glob); fflush(fp); }
+	// the same block scheme as in evolve: threads fill kpair_contrib, contributions are added in k-pair order
+	for (int ikpair0 = 0; ikpair0 < nkpair_proc; ikpair0 += kpair_block){
+		int ikpair1 = std::min(ikpair0 + kpair_block, nkpair_proc);
+#pragma omp parallel for schedule(dynamic)
+		for (int ikpair_local = ikpair0; ikpair_local < ikpair1; ikpair_local++){
+			kpair_work& w = work[ithread_omp()];
+			complex **c = kpair_contrib[ikpair_local - ikpair0]; // c[0]: ddmdt at k; c[1]: ddmdt at k'
+			kpair_active[ikpair_local - ikpair0] = false;
+			int ik_glob = k1st[ikpair_local];
+			int ikp_glob = k2nd[ikpair_local];
+			bool isIntravellay = latt->isIntravalley(elec->kvec[ik_glob], elec->kvec[ikp_glob]);
+			if (isIntravellay && alg.only_intervalley) continue;
+			if (!isIntravellay && alg.only_intravalley) continue;
+			if (!alg.summode) continue;
+			kpair_active[ikpair_local - ikpair0] = true;
+			zeros(c[0], nb*nb); zeros(c[1], nb*nb);
 
-		if (alg.summode){
-			if (!alg.expt){
-				compute_ddmdt(dm[ikp_glob], Lscij[ikpair_local], ddmdt_eph[ik_glob]);
+			if (sLscij != nullptr){
+				sparse_mat *sij = sLscij->smat[ikpair_local], *sji = sLscji->smat[ikpair_local];
+				if (alg.expt) { compute_sPt(expe[ik_glob], expe[ikp_glob], sij, w.smat1_time, false, w); sij = w.smat1_time; }
+				compute_ddmdt(dm[ikp_glob], sij, c[0], w.contrib);
+				if (ik_glob < ikp_glob){
+					if (alg.expt) { compute_sPt(expe[ikp_glob], expe[ik_glob], sji, w.smat2_time, false, w); sji = w.smat2_time; }
+					compute_ddmdt(dm[ik_glob], sji, c[1], w.contrib);
+				}
+			}
+			else if (!alg.expt){
+				compute_ddmdt(dm[ikp_glob], Lscij[ikpair_local], c[0], w.contrib);
 				if (ik_glob < ikp_glob)
-					compute_ddmdt(dm[ik_glob], Lscji[ikpair_local], ddmdt_eph[ikp_glob]);
+					compute_ddmdt(dm[ik_glob], Lscji[ikpair_local], c[1], w.contrib);
 			}
 			else{
-				compute_Pt(t, e[ik_glob], e[ikp_glob], Lscij[ikpair_local], Lsct, false);
-				compute_ddmdt(dm[ikp_glob], Lsct, ddmdt_eph[ik_glob]);
+				compute_Pt(expe[ik_glob], expe[ikp_glob], Lscij[ikpair_local], w.P1t, false, w);
+				compute_ddmdt(dm[ikp_glob], w.P1t, c[0], w.contrib);
 				if (ik_glob < ikp_glob){
-					compute_Pt(t, e[ikp_glob], e[ik_glob], Lscji[ikpair_local], Lsct, false);
-					compute_ddmdt(dm[ik_glob], Lsct, ddmdt_eph[ikp_glob]);
+					compute_Pt(expe[ikp_glob], expe[ik_glob], Lscji[ikpair_local], w.P1t, false, w);
+					compute_ddmdt(dm[ik_glob], w.P1t, c[1], w.contrib);
 				}
 			}
 		}
+
+		for (int ikpair_local = ikpair0; ikpair_local < ikpair1; ikpair_local++){
+			if (!kpair_active[ikpair_local - ikpair0]) continue;
+			complex **c = kpair_contrib[ikpair_local - ikpair0];
+			int ik_glob = k1st[ikpair_local];
+			int ikp_glob = k2nd[ikpair_local];
+			int ir = alg.distribute_dm ? kh.ih(ik_glob) : ik_glob, irp = alg.distribute_dm ? kh.ih(ikp_glob) : ikp_glob;
+			axbyc(ddmdt_acc[ir], c[0], nb*nb, c1, c1);
+			if (ik_glob < ikp_glob) axbyc(ddmdt_acc[irp], c[1], nb*nb, c1, c1);
+		}
 	}
 
-	mp->allreduce(ddmdt_eph, nk_glob, nb*nb, MPI_SUM);
+	if (!alg.distribute_dm)
+		mp->allreduce(ddmdt_eph, nk_glob, nb*nb, MPI_SUM);
+	else{
+		complex **ddmdt_own = ddmdt_eph + kh.ik0_glob; // owned rows of ddmdt_eph
+		kh.reduce_to_owner(ddmdt_acc, ddmdt_own, nb*nb);
+		mpk.allgather(ddmdt_eph, nk_glob, nb*nb);
+	}
 	//if (ldebug) fclose(fp);
 }
 
-void electronphonon::compute_ddmdt(complex *dmkp, complex *lsc, complex *ddmdtk){
-	zeros(ddmdt_contrib, nb*nb);
-	zgemm_interface(ddmdt_contrib, lsc, dmkp, nb*nb, 1, nb*nb);
+void electronphonon::compute_ddmdt(complex *dmkp, complex *lsc, complex *ddmdtk, complex *contrib){
+	zgemm_interface(contrib, lsc, dmkp, nb*nb, 1, nb*nb);
 	for (int i = 0; i < nb; i++)
 	for (int j = 0; j < nb; j++)
-		ddmdtk[i*nb + j] += (prefac_eph*0.5) * (ddmdt_contrib[i*nb + j] + conj(ddmdt_contrib[j*nb + i]));
+		ddmdtk[i*nb + j] += (prefac_eph*0.5) * (contrib[i*nb + j] + conj(contrib[j*nb + i]));
 }
-
-inline void electronphonon::compute_Pt(double t, double *ek, double *ekp, complex *P, complex *Pt, bool minus){
-	// P1_n3n2,n4n5 = G^+-_n3n4 * conj(G^+-_n2n5) * nq^+-
-	// P1_n3n2,n4n5(t) = P1_n3n2,n4n5 * exp[i*t*(e^k_n3 - e^kp_n4 - e^k_n2 + e^kp_n5)]
-	// P2_n3n4,n1n5 = G^-+_n1n3 * conj(G^-+_n5n4) * nq^+-
-	// P2_n3n4,n1n5(t) = P2_n3n4,n1n5 * exp[i*t*(e^k_n1 - e^kp_n3 - e^k_n5 + e^kp_n4)]
-	for (int i1 = 0; i1 < nb; i1++){
-		int n1 = i1*nb;
-		for (int i2 = 0; i2 < nb; i2++){
-			int n12 = (n1 + i2)*nb;
-			for (int i3 = 0; i3 < nb; i3++){
-				int n123 = (n12 + i3)*nb;
-				for (int i4 = 0; i4 < nb; i4++){
-					if (!minus) Pt[n123 + i4] = P[n123 + i4] * cis((ek[i1] - ekp[i3] - ek[i2] + ekp[i4])*t);
-					else Pt[n123 + i4] = P[n123 + i4] * cis((ek[i3] - ekp[i1] - ek[i4] + ekp[i2])*t);
-				}
-			}
-		}
-	}
+void electronphonon::compute_ddmdt(complex *dmkp, sparse_mat *lsc, complex *ddmdtk, complex *contrib){
+	sparse_zgemm(contrib, true, lsc, dmkp, nb*nb, 1, nb*nb);
+	for (int i = 0; i < nb; i++)
+	for (int j = 0; j < nb; j++)
+		ddmdtk[i*nb + j] += (prefac_eph*0.5) * (contrib[i*nb + j] + conj(contrib[j*nb + i]));
 }
\ No newline at end of file
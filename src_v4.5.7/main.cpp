@@ -63,7 +63,11 @@ void dm_dynamics_jdftx(parameters* param){
 
 	// electron-phonon
 	electronphonon* eph = new electronphonon(&mpkpair, latt, param, elec, ph, alg.eph_sepr_eh, !alg.eph_need_elec);
-	if (alg.scatt_enable) mpkpair.distribute_var("dm_dynamics_jdftx", eph->nkpair_glob);
+	if (alg.scatt_enable){
+		vector<double> weight;
+		if (alg.balance_kpair && eph->get_kpair_weights(weight)) mpkpair.distribute_var("dm_dynamics_jdftx", weight);
+		else mpkpair.distribute_var("dm_dynamics_jdftx", eph->nkpair_glob);
+	}
 	if (alg.scatt_enable) eph->set_eph();
 	if (alg.scatt_enable && alg.linearize && param->need_imsig) eph->compute_imsig();
 	if (alg.scatt_enable) eph->analyse_g2(param->de_measure, param->degauss_measure, param->degthr);
@@ -76,9 +80,18 @@ void dm_dynamics_jdftx(parameters* param){
 	//==================================================
 	// evolve density matrix
 	//==================================================
-	if (param->compute_tau_only) return;
-	if (alg.ode_method == "rkf45")
-		dmdyn->evolve_gsl();
-	else if (alg.ode_method == "euler")
-		dmdyn->evolve_euler();
+	// the observable files opened by the constructor are closed in all cases
+	if (param->compute_eigenmodes)
+		dmdyn->compute_eigenmodes();
+	else if (!param->compute_tau_only){
+		if (alg.ode_method == "rkf45")
+			dmdyn->evolve_gsl();
+		else if (alg.ode_method == "euler")
+			dmdyn->evolve_euler();
+		else if (alg.ode_method == "ros2")
+			dmdyn->evolve_ros2();
+		else if (alg.ode_method == "expmv")
+			dmdyn->evolve_expmv();
+	}
+	if (ionode) obw.close();
 }
@@ -16,6 +16,7 @@ public:
 		freq_measure(param->freq_measure), freq_measure_ene(param->freq_measure_ene), freq_compute_tau(param->freq_compute_tau),
 		print_tot_band(param->print_tot_band), print_layer_occ(elec->print_layer_occ), print_layer_spin(elec->print_layer_spin)
 	{
+		obw.init(param->ob_format == "binary", param->freq_flush);
 		//it_start_ddm = last_file_index("ddm_along_kpath_results/ddm.", ".dat");
 		//if (ionode) { printf("\nit_start_ddm = %d\n", it_start_ddm); fflush(stdout); }
 	}
@@ -31,7 +32,16 @@ public:
 	complex ***s, **layer, **layerspin, ***l, ***v;
 	bool needL;
 	GaussianSmapling *gauss_elec, *gauss_hole, *gauss_dot_elec, *gauss_dot_hole;
-	double *obk, *tot_band, *tot_valley, **tot_valley_band;
+	double *obk;
+	// partial sums of one band range over the k points of this process (mpk); measure sums them over processes in one MPI_Reduce
+	struct ob_sums{
+		double tot, tot_amp, dottot, dottot_amp, tot_tplusdt, dottot_term2, entropy, entropy_eq;
+		vector3<double> tot_t2star;
+		std::vector<double> band, valley, valley_band; // valley_band[iv*nb + i - bStart]
+		GaussianSmapling *gauss;
+	};
+	ob_sums sums_elec, sums_hole;
+	std::vector<double> sums_buf;
 	std::vector<int> ik_kpath;
 	complex **ddm_eq, **ddm_neq;
 	double trace_sq_ddm_tot, trace_sq_ddmneq_tot, *trace_sq_ddm_eq, *trace_sq_ddm_neq;
@@ -73,9 +83,12 @@ public:
 		else
 			this->v = nullptr;
 		obk = new double[nk_glob]; zeros(obk, nk_glob);
-		tot_band = new double[nb]; zeros(tot_band, nb);
-		tot_valley = new double[(int)latt->vpos.size()]; zeros(tot_valley, (int)latt->vpos.size());
-		tot_valley_band = alloc_real_array((int)latt->vpos.size(), nb);
+		int nvalley = (int)latt->vpos.size();
+		for (ob_sums *sums : { &sums_elec, &sums_hole }){
+			sums->band.resize(nb); sums->valley.resize(nvalley); sums->valley_band.resize(nvalley*nb);
+		}
+		sums_elec.gauss = nb > nv ? gauss_elec : nullptr;
+		sums_hole.gauss = nv > 0 ? gauss_hole : nullptr;
 
 		/*
 		if (ddm_eq != nullptr){
@@ -105,7 +118,9 @@ public:
 	}
 
 	void measure(string what, string label, bool diff, bool print_ene, double t, complex **dm, complex **ddmdt = nullptr, double dt = 0);
-	void measure_brange(string what, bool diff, bool print_ene, double t, complex **dm, complex **ddmdt, double dt, int bStart, int bEnd, string scarr, GaussianSmapling *gauss, GaussianSmapling *gauss_dot);
+	void measure_brange(string what, bool diff, double t, complex **dm, complex **ddmdt, double dt, int bStart, int bEnd, bool isHole, ob_sums& sums);
+	void print_brange(string what, bool diff, bool print_ene, double t, complex **ddmdt, double dt, int bStart, int bEnd, string scarr, ob_sums& sums);
+	void pack_sums(ob_sums& sums, size_t& pos, bool pack);
 	void ddmk_ana_drive(int it, double t, complex **dm);
 	void ddmk_ana(int it, double t, complex **dm);
 };
@@ -114,13 +129,42 @@ template<class Tl, class Te>
 void ob_1dmk<Tl, Te>::measure(string what, string label, bool diff, bool print_ene, double t, complex **dm, complex **ddmdt, double dt){
 	if (ddmdt && !diff) error_message("ddmdt && !diff");
 	if (ddmdt && (what == "dos" || what == "fn" || what.substr(0, 4) == "s-t2" || what.substr(0, 7) == "entropy")) error_message("ddmdt && (dos || fn || s-t2 || entropy)");
-	MPI_Barrier(MPI_COMM_WORLD);
-	if (ionode && nb > nv)
-		measure_brange(what, diff, print_ene, t, dm, ddmdt, dt, nv, nb, "_elec" + label, gauss_elec, gauss_dot_elec);
-	MPI_Barrier(MPI_COMM_WORLD);
-	if (ionode && nv > 0)
-		measure_brange(what, diff, print_ene, t, dm, ddmdt, dt, 0, nv, "_hole" + label, gauss_hole, gauss_dot_hole);
-	MPI_Barrier(MPI_COMM_WORLD);
+	if ((what == "jx" || what == "jy" || what == "jz") && v == nullptr) return;
+
+	// every process sums over its own k points; partial sums of all quantities and both band ranges are reduced together
+	bool has_elec = nb > nv, has_hole = nv > 0;
+	if (has_elec) measure_brange(what, diff, t, dm, ddmdt, dt, nv, nb, false, sums_elec);
+	if (has_hole) measure_brange(what, diff, t, dm, ddmdt, dt, 0, nv, true, sums_hole);
+	size_t pos = 0;
+	if (has_elec) pack_sums(sums_elec, pos, true);
+	if (has_hole) pack_sums(sums_hole, pos, true);
+	MPI_Reduce(ionode ? MPI_IN_PLACE : sums_buf.data(), sums_buf.data(), (int)pos, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	if (!ionode) return;
+	pos = 0;
+	if (has_elec) pack_sums(sums_elec, pos, false);
+	if (has_hole) pack_sums(sums_hole, pos, false);
+
+	if (has_elec) print_brange(what, diff, print_ene, t, ddmdt, dt, nv, nb, "_elec" + label, sums_elec);
+	if (has_hole) print_brange(what, diff, print_ene, t, ddmdt, dt, 0, nv, "_hole" + label, sums_hole);
+}
+
+template<class Tl, class Te>
+void ob_1dmk<Tl, Te>::pack_sums(ob_sums& sums, size_t& pos, bool pack){
+	std::vector<double*> scalars{ &sums.tot, &sums.tot_amp, &sums.dottot, &sums.dottot_amp, &sums.tot_tplusdt, &sums.dottot_term2, &sums.entropy, &sums.entropy_eq,
+		&sums.tot_t2star[0], &sums.tot_t2star[1], &sums.tot_t2star[2] };
+	std::vector<std::vector<double>*> arrays{ &sums.band, &sums.valley, &sums.valley_band, &sums.gauss->out };
+	size_t n = scalars.size();
+	for (auto a : arrays) n += a->size();
+	if (pack && sums_buf.size() < pos + n) sums_buf.resize(pos + n);
+	for (auto x : scalars){
+		if (pack) sums_buf[pos] = *x; else *x = sums_buf[pos];
+		pos++;
+	}
+	for (auto a : arrays){
+		if (pack) std::copy(a->begin(), a->end(), sums_buf.begin() + pos);
+		else std::copy(sums_buf.begin() + pos, sums_buf.begin() + pos + a->size(), a->begin());
+		pos += a->size();
+	}
 }
 
 bool in_obSet(std::vector<string>& obSet, string var){
@@ -128,9 +172,7 @@ bool in_obSet(std::vector<string>& obSet, string var){
 }
 
 template<class Tl, class Te>
-void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, double t, complex **dm, complex **ddmdt, double dt, int bStart, int bEnd, string scarr, GaussianSmapling *gauss, GaussianSmapling *gauss_dot){
-	if (!ionode) return;
-
+void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, double t, complex **dm, complex **ddmdt, double dt, int bStart, int bEnd, bool isHole, ob_sums& sums){
 	std::vector<string> obSet{ "sx", "sy", "sz", "lx", "ly", "lz", "layer", "layerspin", "s-t2-wu", "s-t2-mani", "s-t2star", "entropy_vN", "entropy_bloch", "jx", "jy", "jz" };
 	std::vector<string> obSet1{ "sx", "sy", "sz", "lx", "ly", "lz", "jx", "jy", "jz" };
 	std::vector<string> obSet1s{ "sx", "sy", "sz" };
@@ -140,70 +182,26 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 	std::vector<string> obSet4{ "entropy_vN", "entropy_bloch" };
 	std::vector<string> obSet1j{ "jx", "jy", "jz" };
 
-	if (in_obSet(obSet1j, what) and v == nullptr) return;
-
-	// open files
-	bool isHole = scarr.substr(1, 4) == "hole";
-	string fname;
-	FILE *fil, *filtot;
-	if (!diff) scarr = "_initial" + scarr;
-	int idir;
-	if (what == "fn"){
-		fname = what + scarr + ".out"; fil = fopen(fname.c_str(), "a");
-		if (diff){
-			fname = what + scarr + "_tot.out";
-			if (!exists(fname)){
-				filtot = fopen(fname.c_str(), "a");
-				fprintf(filtot, "#time(au), total f, f in each valley\n");
-			}
-			else filtot = fopen(fname.c_str(), "a");
-		}
-	}
-	else if (in_obSet(obSet, what)){
-		if ((!in_obSet(obSet1, what)) && (print_ene || ddmdt))
-			error_message("print_ene is not allowed for layer population/spin currently");
-		if (print_ene && !diff) error_message("print_ene && !diff is not allowed currently");
-		if (what == "sx" || what == "lx" || what == "jx") idir = 0;
-		else if (what == "sy" || what == "ly" || what == "jy") idir = 1;
-		else if (what == "sz" || what == "lz" || what == "jz") idir = 2;
-		if (!ddmdt && diff){
-			fname = what + scarr + "_ene.out";
-			if (in_obSet(obSet1, what)) fil = fopen(fname.c_str(), "a");
-			fname = what + scarr + "_tot.out";
-			if (!exists(fname)){
-				filtot = fopen(fname.c_str(), "a");
-				if (in_obSet(obSet1s, what)) fprintf(filtot, "#time(au), s(t), s(t) without exp(iwt)\n");
-				else if (in_obSet(obSet1l, what)) fprintf(filtot, "#time(au), l(t), l(t) without exp(iwt)\n");
-				else if (in_obSet(obSet1j, what)) fprintf(filtot, "#time(au), j(t), j(t) without exp(iwt)\n");
-				else if (what == "s-t2-wu" || what == "s-t2star") fprintf(filtot, "#time(au), s-t2(t)\n");
-				else if (in_obSet(obSet4, what)) fprintf(filtot, "#time(au), sqrt(entropy)(t)\n");
-				else if (what == "s-t2-mani") fprintf(filtot, "#time(au), sqrt(spin part of entropy)(t)\n");
-				else fprintf(filtot, "#time(au), layer population/spin, without exp(iwt)\n");
-			}
-			else filtot = fopen(fname.c_str(), "a");
-		}
-		else if (ddmdt){
-			fname = "tau_" + what + scarr + "_tot.out";
-			if (!exists(fname)){
-				filtot = fopen(fname.c_str(), "a");
-				fprintf(filtot, "#time(au), tau by FD, tau without precession, tau\n");
-			}
-			else filtot = fopen(fname.c_str(), "a");
-		}
-	}
-	else if (what == "dos"){ fname = what + scarr + ".out"; fil = fopen(fname.c_str(), "a"); }
+	int idir = 0;
+	if (what == "sx" || what == "lx" || what == "jx") idir = 0;
+	else if (what == "sy" || what == "ly" || what == "jy") idir = 1;
+	else if (what == "sz" || what == "lz" || what == "jz") idir = 2;
 
 	// initialization
-	double prefac = in_obSet(obSet1j, what) ? prefac_cmby_per_cell_size_cmd : prefac_per_cell_size_cmd;
-	double tot = 0, tot_amp = 0, dottot = 0, dottot_amp = 0, tot_tplusdt = 0, dottot_term2 = 0;
-	vector3<double> tot_t2star(0, 0, 0);
-	double entropy = 0, entropy_eq = 0;
+	double &tot = sums.tot, &tot_amp = sums.tot_amp, &dottot = sums.dottot, &dottot_amp = sums.dottot_amp, &tot_tplusdt = sums.tot_tplusdt, &dottot_term2 = sums.dottot_term2;
+	vector3<double>& tot_t2star = sums.tot_t2star;
+	double &entropy = sums.entropy, &entropy_eq = sums.entropy_eq;
+	double *tot_band = sums.band.data(), *tot_valley = sums.valley.data(), *tot_valley_band = sums.valley_band.data();
+	GaussianSmapling *gauss = sums.gauss;
+	tot = 0; tot_amp = 0; dottot = 0; dottot_amp = 0; tot_tplusdt = 0; dottot_term2 = 0;
+	tot_t2star = vector3<double>(0, 0, 0);
+	entropy = 0; entropy_eq = 0;
 	zeros(obk, nk_glob); zeros(tot_band, nb);
-	zeros(tot_valley, (int)this->latt->vpos.size()); zeros(tot_valley_band, (int)this->latt->vpos.size(), nb);
+	zeros(tot_valley, (int)this->latt->vpos.size()); zeros(tot_valley_band, (int)this->latt->vpos.size() * nb);
 	gauss->reset();
 
 	// compute observables
-	for (int ik_glob = 0; ik_glob < nk_glob; ik_glob++){
+	for (int ik_glob = (int)mpk.varstart; ik_glob < (int)mpk.varend; ik_glob++){
 		int iv = this->latt->whichvalley(this->elec->kvec[ik_glob]);
 
 		if (what == "entropy_vN"){
@@ -332,7 +330,7 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 				}
 				obk[ik_glob] += ob; tot_band[i - bStart] += ob;
 				tot += ob; tot_amp += ob_amp; tot_tplusdt += ob_tplusdt;
-				if (iv >= 0) { tot_valley[iv] += ob; tot_valley_band[iv][i - bStart] += ob; }
+				if (iv >= 0) { tot_valley[iv] += ob; tot_valley_band[iv*nb + i - bStart] += ob; }
 				dottot += dot_; dottot_amp += dot_amp; dottot_term2 += dot_term2;
 
 				double ene = e[ik_glob][i];
@@ -341,6 +339,59 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 			}
 		}
 	}
+}
+
+template<class Tl, class Te>
+void ob_1dmk<Tl, Te>::print_brange(string what, bool diff, bool print_ene, double t, complex **ddmdt, double dt, int bStart, int bEnd, string scarr, ob_sums& sums){
+	std::vector<string> obSet{ "sx", "sy", "sz", "lx", "ly", "lz", "layer", "layerspin", "s-t2-wu", "s-t2-mani", "s-t2star", "entropy_vN", "entropy_bloch", "jx", "jy", "jz" };
+	std::vector<string> obSet1{ "sx", "sy", "sz", "lx", "ly", "lz", "jx", "jy", "jz" };
+	std::vector<string> obSet1s{ "sx", "sy", "sz" };
+	std::vector<string> obSet1l{ "lx", "ly", "lz" };
+	std::vector<string> obSet2{ "layer", "layerspin" };
+	std::vector<string> obSet3{ "s-t2-wu", "s-t2-mani", "s-t2star" };
+	std::vector<string> obSet4{ "entropy_vN", "entropy_bloch" };
+	std::vector<string> obSet1j{ "jx", "jy", "jz" };
+
+	// files are kept open by obw; time series rows go through obw.row, so that they can also go to the binary container
+	string fname, fname_tot, header;
+	FILE *fil = nullptr, *filtot = nullptr;
+	if (!diff) scarr = "_initial" + scarr;
+	if (what == "fn"){
+		fname = what + scarr + ".out"; fil = obw.text(fname);
+		if (diff){
+			fname_tot = what + scarr + "_tot.out";
+			header = "#time(au), total f, f in each valley\n";
+		}
+	}
+	else if (in_obSet(obSet, what)){
+		if ((!in_obSet(obSet1, what)) && (print_ene || ddmdt))
+			error_message("print_ene is not allowed for layer population/spin currently");
+		if (print_ene && !diff) error_message("print_ene && !diff is not allowed currently");
+		if (!ddmdt && diff){
+			fname = what + scarr + "_ene.out";
+			if (in_obSet(obSet1, what)) fil = obw.text(fname);
+			fname_tot = what + scarr + "_tot.out";
+			if (in_obSet(obSet1s, what)) header = "#time(au), s(t), s(t) without exp(iwt)\n";
+			else if (in_obSet(obSet1l, what)) header = "#time(au), l(t), l(t) without exp(iwt)\n";
+			else if (in_obSet(obSet1j, what)) header = "#time(au), j(t), j(t) without exp(iwt)\n";
+			else if (what == "s-t2-wu" || what == "s-t2star") header = "#time(au), s-t2(t)\n";
+			else if (in_obSet(obSet4, what)) header = "#time(au), sqrt(entropy)(t)\n";
+			else if (what == "s-t2-mani") header = "#time(au), sqrt(spin part of entropy)(t)\n";
+			else header = "#time(au), layer population/spin, without exp(iwt)\n";
+		}
+		else if (ddmdt){
+			fname = "tau_" + what + scarr + "_tot.out";
+			filtot = obw.text(fname, "#time(au), tau by FD, tau without precession, tau\n");
+		}
+	}
+	else if (what == "dos"){ fname = what + scarr + ".out"; fil = obw.text(fname); }
+
+	double prefac = in_obSet(obSet1j, what) ? prefac_cmby_per_cell_size_cmd : prefac_per_cell_size_cmd;
+	double &tot = sums.tot, &tot_amp = sums.tot_amp, &dottot = sums.dottot, &dottot_amp = sums.dottot_amp, &tot_tplusdt = sums.tot_tplusdt, &dottot_term2 = sums.dottot_term2;
+	vector3<double>& tot_t2star = sums.tot_t2star;
+	double &entropy = sums.entropy, &entropy_eq = sums.entropy_eq;
+	double *tot_band = sums.band.data(), *tot_valley = sums.valley.data(), *tot_valley_band = sums.valley_band.data();
+	GaussianSmapling *gauss = sums.gauss;
 
 	// total quantities
 	if (in_obSet(obSet4, what)){
@@ -356,11 +407,11 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 	else{
 		tot *= prefac; tot_amp *= prefac; tot_tplusdt *= prefac;
 		for (int i = 0; i < bEnd - bStart; i++)
-			tot_band[i - bStart] *= prefac;
+			tot_band[i] *= prefac;
 		for (int iv = 0; iv < this->latt->vpos.size(); iv++){
 			tot_valley[iv] *= prefac;
 			for (int i = 0; i < bEnd - bStart; i++)
-				tot_valley_band[iv][i] *= prefac;
+				tot_valley_band[iv*nb + i] *= prefac;
 		}
 		dottot *= prefac; dottot_amp *= prefac; dottot_term2 *= prefac;
 	}
@@ -368,21 +419,20 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 	if (what != "dos"){
 		if (!ddmdt){
 			if (diff){
-				if (fabs(t) < 1e-30) fprintf(filtot, " 0.00000000000000e+01 %21.14le", tot);
-				else fprintf(filtot, "%21.14le %21.14le", t, tot);
+				std::vector<double> cols{ t, tot };
 				if (what != "s-t2star" && what != "s-t2-wu" && what != "s-t2-mani" && what != "entropy_bloch" && what != "entropy_vN"){
 					for (int iv = 0; iv < this->latt->vpos.size(); iv++)
-					if (what == "fn") fprintf(filtot, " %21.14le", tot_valley[iv]);
+					if (what == "fn") cols.push_back(tot_valley[iv]);
 					if (this->print_tot_band){
 						for (int i = 0; i < bEnd - bStart; i++)
-							fprintf(filtot, " %21.14le", tot_band[i]);
+							cols.push_back(tot_band[i]);
 						for (int iv = 0; iv < this->latt->vpos.size(); iv++)
 						for (int i = 0; i < bEnd - bStart; i++)
-						if (what == "fn") fprintf(filtot, " %21.14le", tot_valley_band[iv][i]);
+						if (what == "fn") cols.push_back(tot_valley_band[iv*nb + i]);
 					}
-					if (what != "fn") fprintf(filtot, " %21.14le", tot_amp);
+					if (what != "fn") cols.push_back(tot_amp);
 				}
-				fprintf(filtot, "\n");
+				obw.row(fname_tot, header, cols);
 			}
 			else{
 				if (in_obSet(obSet4, what) || what == "s-t2-mani") printf("\ninitial %s density %21.14le\n", what.c_str(), tot*tot);
@@ -401,7 +451,6 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 			}
 		}
 	}
-	if (what != "dos" && diff) { fflush(filtot); fclose(filtot); }
 
 	// energy-resolved quantities
 	if (!ddmdt && print_ene) fprintf(fil, "**************************************************\n");
@@ -413,8 +462,7 @@ void ob_1dmk<Tl, Te>::measure_brange(string what, bool diff, bool print_ene, dou
 		else fprintf(fil, "time and density:  %21.14le %21.14le\n", t, tot); // carrier density in fn_ene.out
 	}
 	if (!ddmdt && print_ene) fprintf(fil, "**************************************************\n");
-	if (what == "fn" || what == "dos" || (!ddmdt &&  diff && in_obSet(obSet1, what))) fflush(fil); fflush(stdout);
-	if (what == "fn" || what == "dos" || (!ddmdt &&  diff && in_obSet(obSet1, what))) fclose(fil);
+	fflush(stdout);
 }
 /*
 template<class Tl, class Te>
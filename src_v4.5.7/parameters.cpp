@@ -3,6 +3,7 @@
 #include "PumpProbe.h"
 #include "Scatt_Param.h"
 #include "ODE.h"
+#include "checkpoint.h"
 
 void parameters::read_jdftx(){
 	FILE *fp = fopen("ldbd_data/ldbd_size.dat", "r");
@@ -71,6 +72,7 @@ void parameters::read_param(){
 	if (ionode && !restart && material_model == "none") system("mkdir restart");
 	MPI_Barrier(MPI_COMM_WORLD);
 	compute_tau_only = get(param_map, "compute_tau_only", false);
+	compute_eigenmodes = get(param_map, "compute_eigenmodes", false);
 
 	if (ionode) printf("\n**************************************************\n");
 	if (ionode) printf("Master equation control parameters:\n");
@@ -118,6 +120,17 @@ void parameters::read_param(){
 	alg.Pin_is_sparse = get(param_map, "alg_Pin_is_sparse", 0);
 	alg.sparseP = get(param_map, "alg_sparseP", 0);
 	alg.thr_sparseP = get(param_map, "alg_thr_sparseP", 1e-40);
+	// with sparse P, each process gets k pairs with about the same total number of nonzeros
+	alg.balance_kpair = get(param_map, "alg_balance_kpair", 1);
+	// with many processes per node, the binary ldbd_data inputs are read from the filesystem once per node
+	alg.mmap_ldbd = get(param_map, "alg_mmap_ldbd", 0);
+	ldbd_file::use_mmap = alg.mmap_ldbd;
+	// with many processes per node, matrices needed for all k are not duplicated on every process
+	alg.shm_arrays = get(param_map, "alg_shm_arrays", 0);
+	node_shm::enabled = alg.shm_arrays;
+	// e-i and e-e models and RPA screening reuse the overlaps <k|k'> within a memory budget (MB per process)
+	alg.ovlp_cache_mb = get(param_map, "alg_ovlp_cache_mb", 0);
+	alg.ovlp_precompute = get(param_map, "alg_ovlp_precompute", 0);
 
 	if (ionode) printf("\nphenomenological relaxation parameters:\n");
 	alg.phenom_relax = get(param_map, "alg_phenom_relax", 0);
@@ -229,6 +242,11 @@ void parameters::read_param(){
 	eep.antisymmetry = get(param_map, "ee_antisymmetry", 0);
 	eep.degauss = get(param_map, "degauss_ee", degauss / eV, eV);
 	freq_update_ee_model = get(param_map, "freq_update_ee_model", 0);
+	// updates of e-i and e-e P rescale them by the change of static screening, instead of rebuilding them, within tolerances of
+	// the relative change of |vq|^2 and of the absolute change of dm elements (e-e only) since the last full rebuild
+	alg.rescale_scatt = get(param_map, "alg_rescale_scatt", 0);
+	alg.rescale_scatt_tol_vq2 = get(param_map, "alg_rescale_scatt_tol_vq2", 0.02);
+	alg.rescale_scatt_tol_dm = get(param_map, "alg_rescale_scatt_tol_dm", 0.01);
 
 	if (ionode) printf("\n**************************************************\n");
 	if (ionode) printf("Spin generation and measurement parameters:\n");
@@ -299,6 +317,7 @@ void parameters::read_param(){
 	if (!restart)
 		t0 = get(param_map, "t0", 0., fs);
 	else{
+		dm_checkpoint::recover();
 		if (FILE *ftime = fopen("restart/time_restart.dat", "r")){
 			char s[200];
 			if (fgets(s, sizeof s, ftime) != NULL){
@@ -324,6 +343,10 @@ void parameters::read_param(){
 	freq_measure = get(param_map, "freq_measure", 1);
 	freq_measure_ene = get(param_map, "freq_measure_ene", 10);
 	freq_compute_tau = get(param_map, "freq_compute_tau", freq_measure_ene);
+	ob_format = getString(param_map, "ob_format", "text");
+	freq_flush = get(param_map, "freq_flush", 1);
+	freq_checkpoint = get(param_map, "freq_checkpoint", freq_measure);
+	checkpoint_async = get(param_map, "checkpoint_async", 0);
 	de_measure = get(param_map, "de_measure", 5e-4, eV);
 	degauss_measure = get(param_map, "degauss_measure", 2e-3, eV);
 
@@ -356,6 +379,12 @@ void parameters::read_param(){
 	if (ionode) printf("sdir_y: %lg %lg %lg\n", sdir_y[0], sdir_y[1], sdir_y[2]);
 	sdir_rot.set_rows(sdir_x, sdir_y, sdir_z);
 
+	if (ionode) printf("\nparallelization parameters:\n");
+	alg.distribute_dm = get(param_map, "alg_distribute_dm", 0);
+	alg.nthreads = get(param_map, "nthreads", 1);
+	set_nthreads_omp(alg.nthreads);
+	if (ionode && alg.nthreads != nthreads_omp()) printf("nthreads = %d is not used, the code is compiled without OpenMP\n", alg.nthreads);
+
 	if (ionode) printf("\nODE parameters:\n");
 	alg.ode_method = getString(param_map, "alg_ode_method", "rkf45");
 	// ODE (ordinary derivative equation) parameters
@@ -365,6 +394,20 @@ void parameters::read_param(){
 	double dtmp = pmp.laserAlg == "coherent" ? 1 : tstep_laser / fs;
 	ode.hmax_laser = get(param_map, "ode_hmax_laser", dtmp, fs);
 	ode.epsabs = get(param_map, "ode_epsabs", 1e-8);
+	if (alg.ode_method == "ros2"){
+		ode.krylov_dim = get(param_map, "ode_krylov_dim", 20);
+		ode.krylov_tol = get(param_map, "ode_krylov_tol", 1e-3);
+	}
+	if (alg.ode_method == "expmv" || compute_eigenmodes)
+		ode.krylov_dim = get(param_map, "ode_krylov_dim", 30);
+	if (compute_eigenmodes){
+		if (ionode) printf("\neigenmode parameters:\n");
+		eig_nmodes = get(param_map, "eig_nmodes", 6);
+		eig_krylov_dim = get(param_map, "eig_krylov_dim", 20);
+		eig_nrestart = get(param_map, "eig_nrestart", 10);
+		eig_tau = get(param_map, "eig_tau", tstep / fs, fs); // modes decaying much faster than 1/eig_tau are filtered out
+		eig_tol = get(param_map, "eig_tol", 1e-6);
+	}
 
 	/*
 	if (ionode) printf("\nkpath realted parameters:\n");
@@ -431,12 +474,10 @@ void parameters::read_param(){
 		error_message("linearization is only supported when we use the generalized scattering-rate matrices P?", "read_param");
 	if (alg.linearize && (pmp.laserAlg == "lindblad" || pmp.laserAlg == "coherent"))
 		error_message("linearization is not allowed for real-time laser", "read_param");
-	if (alg.linearize && (alg.Pin_is_sparse || alg.sparseP))
-		error_message("linearization does not support sparse matrices", "read_param");
 	if (alg.linearize && alg.linearize_dPee)
 		error_message("alg_linearize_dPee and alg.linearize cannot be both true", "read_param");
 	if (alg.linearize_dPee && (alg.Pin_is_sparse || alg.sparseP))
-		error_message("linearization does not support sparse matrices", "read_param");
+		error_message("alg_linearize_dPee does not support sparse matrices", "read_param");
 	if (alg.linearize_dPee && !alg.ddmdteq)
 		error_message("linearize_dPee must be used ddmdteq", "read_param");
 	if (eep.eeMode == "none" && alg.linearize_dPee)
@@ -453,8 +494,20 @@ void parameters::read_param(){
 		error_message("in schrodinger picture, alg_expt and alg_expt_elight must be false", "read_param");
 	if (alg.eph_sepr_eh && !alg.eph_need_elec && !alg.eph_need_hole)
 		error_message("if alg_eph_sepr_eh, either alg_eph_need_elec or alg_eph_need_hole", "read_param");
-	if (alg.ode_method != "rkf45" && alg.ode_method != "euler")
-		error_message("alg_ode_method must be rkf45 or euler", "read_param");
+	if (alg.ode_method != "rkf45" && alg.ode_method != "euler" && alg.ode_method != "ros2" && alg.ode_method != "expmv")
+		error_message("alg_ode_method must be rkf45, euler, ros2 or expmv", "read_param");
+	if (alg.ode_method == "expmv" && (!alg.linearize || alg.expt || pmp.active()))
+		error_message("alg_ode_method = expmv needs a time-independent linear operator: alg_linearize, no alg_expt and no laser", "read_param");
+	if (compute_eigenmodes && (!alg.linearize || alg.expt || pmp.active()))
+		error_message("compute_eigenmodes needs a time-independent linear operator: alg_linearize, no alg_expt and no laser", "read_param");
+	if (compute_eigenmodes && (Bpert.length() < 1e-10 || eig_nmodes < 1 || eig_krylov_dim <= eig_nmodes || eig_tau <= 0))
+		error_message("compute_eigenmodes needs Bpert, eig_nmodes >= 1, eig_krylov_dim > eig_nmodes and eig_tau > 0", "read_param");
+	if ((alg.ode_method == "expmv" || compute_eigenmodes) && ode.krylov_dim < 1)
+		error_message("ode_krylov_dim must be >= 1", "read_param");
+	if (alg.ode_method == "ros2" && (ode.krylov_dim < 1 || ode.krylov_tol <= 0 || ode.krylov_tol >= 1))
+		error_message("ode_krylov_dim must be >= 1 and 0 < ode_krylov_tol < 1", "read_param");
+	if (ob_format != "text" && ob_format != "binary")
+		error_message("ob_format must be text or binary", "read_param");
 	clp.check_params();
 	if (alg.only_eimp && eip.ni.size() == 0)
 		error_message("alg_only_eimp is only possible if impurity_density is non-zero", "read_param");
@@ -499,6 +552,12 @@ void parameters::read_param(){
 	if (!alg.linearize && freq_update_eimp_model != freq_update_ee_model)
 		error_message("freq_update_eimp_model is the same as freq_update_ee_model in current version", "read_param");
 
+	if (alg.nthreads < 1)
+		error_message("nthreads must be positive", "read_param");
+	if (alg.ovlp_precompute && alg.ovlp_cache_mb <= 0)
+		error_message("alg_ovlp_precompute needs alg_ovlp_cache_mb > 0", "read_param");
+	if (alg.rescale_scatt && (alg.rescale_scatt_tol_vq2 < 0 || alg.rescale_scatt_tol_dm < 0))
+		error_message("alg_rescale_scatt_tol_vq2 < 0 || alg_rescale_scatt_tol_dm < 0 is not allowed", "read_param");
 	if (ode.hstart < 0 || ode.hmin < 0 || ode.hmax < 0 || ode.hmax_laser < 0 || ode.epsabs < 0)
 		error_message("ode_hstart < 0 || ode_hmin < 0 || ode_hmax < 0 || ode_hmax_laser < 0 || ode_epsabs < 0 is not allowed", "read_param");
 	if (ode.hmin > std::max(ode.hmax, ode.hmax_laser) || ode.hstart > std::max(ode.hmax, ode.hmax_laser))
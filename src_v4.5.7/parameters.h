@@ -5,10 +5,17 @@ class parameters{
   public:
   	bool restart; //!< restart from previous calculation, needs restart directory
     bool compute_tau_only;
+    bool compute_eigenmodes; //!< slowest-decaying eigenmodes of the linearized operator instead of time evolution
+    int eig_nmodes, eig_krylov_dim, eig_nrestart;
+    double eig_tau, eig_tol;
     bool print_tot_band;
     bool print_along_kpath;
   	std::vector<vector3<double>> kpath_start, kpath_end;
   	int freq_measure, freq_measure_ene, freq_compute_tau, freq_update_eimp_model, freq_update_ee_model;
+  	string ob_format; //!< "text": one text file per observable; "binary": time series in observables.bin
+  	int freq_flush; //!< flush observable files every freq_flush reports, <= 0: only at the end
+  	int freq_checkpoint; //!< write restart/denmat_restart.bin every freq_checkpoint time steps, <= 0: only at the end
+  	bool checkpoint_async; //!< write restart checkpoints in a background thread
   	double de_measure, degauss_measure;
   	double t0, tend, tstep, tstep_laser;
   	int nk1, nk2, nk3;
@@ -27,6 +27,7 @@ public:
 		qmin = 100; qmax = 0;
 		if (elec != nullptr){
 			qmap = new qIndexMap(elec->kmesh); qmap->build(elec->kvec, qvec);
+			if (DEBUG && !qmap->same_as_pairs(elec->kvec, qvec)) error_message("q vectors differ from those of all k pairs", "phonon");
 			for (size_t iq = 1; iq < qvec.size(); iq++){ // exclude the first q vector which must be Gamma
 				double qlength = latt->klength(qvec[iq]);
 				if (qlength < qmin) qmin = qlength;
@@ -37,8 +38,8 @@ public:
 				FILE *fpq = fopen(fnameq.c_str(), "w");
 				fprintf(fpq, "\nPrint qIndexMap:\n"); fflush(fpq);
 				for (size_t iq = 0; iq < qvec.size(); iq++){
-					std::map<vector3<int>, size_t>::iterator iter = qmap->the_map.find(qmap->iqvec3(qvec[iq]));
-					fprintf(fpq, "iqvec3 = (%d,%d,%d) iq = %lu\n", iter->first[0], iter->first[1], iter->first[2], iter->second);  fflush(fpq);
+					vector3<int> iqvec3 = qmap->iqvec3(qvec[iq]);
+					fprintf(fpq, "iqvec3 = (%d,%d,%d) iq = %lu\n", iqvec3[0], iqvec3[1], iqvec3[2], qmap->q2iq(qvec[iq]));  fflush(fpq);
 				}
 				fclose(fpq);
 			}
@@ -5,6 +5,7 @@
 #include "parameters.h"
 #include "electron.h"
 #include "mymp.h"
+#include "Ovlp_Cache.h"
 
 struct homogeneous_electron_gas
 {//homogeneous electron gas
@@ -409,7 +410,8 @@ struct coulomb_model
 	vector<complex> qscr2_static_RPA;
 	vector<vector<complex>> vq_RPA;
 	vector<complex> Aq_ppa, Eq2_ppa; double wp2;
-	complex *Uih, *ovlp;
+	complex *ovlp;
+	ovlp_cache *ovlps; // also used by the e-i and e-e models
 	homogeneous_electron_gas *heg;
 
 	coulomb_model(lattice *latt, parameters *param, electron *elec, int bStart, int bEnd, double dE)
@@ -425,10 +427,9 @@ struct coulomb_model
 		//if (ionode) printf("prefac_vq = %10.3le\n", prefac_vq);
 		e = trunc_alloccopy_array(elec->e_dm, nk, bStart, bEnd);
 		f = trunc_alloccopy_array(elec->f_dm, nk, bStart, bEnd);
-		if (clp.scrFormula == "RPA" || clp.scrFormula == "lindhard"){
-			Uih = new complex[nb*elec->nb_wannier]{c0};
+		ovlps = new ovlp_cache(elec, nb, alg.ovlp_cache_mb);
+		if (clp.scrFormula == "RPA" || clp.scrFormula == "lindhard")
 			ovlp = new complex[nb*nb]{c0};
-		}
 
 		//carrier density correction if two k-point lists are used
 		nfreetot_corr = 0;
@@ -448,14 +449,15 @@ struct coulomb_model
 		//initialize qmap and qvec,
 		if (qmap == nullptr){
 			qmap = new qIndexMap(elec->kmesh); qmap->build(elec->kvec, qvec);
+			if (DEBUG && !qmap->same_as_pairs(elec->kvec, qvec)) error_message("q vectors differ from those of all k pairs", "coulomb_model");
 
 			if (ionode && DEBUG){
 				string fnameq = dir_debug + "qIndexMap.out";
 				FILE *fpq = fopen(fnameq.c_str(), "w");
 				fprintf(fpq, "\nPrint qIndexMap:\n"); fflush(fpq);
 				for (size_t iq = 0; iq < qvec.size(); iq++){
-					std::map<vector3<int>, size_t>::iterator iter = qmap->the_map.find(qmap->iqvec3(qvec[iq]));
-					fprintf(fpq, "iqvec3 = (%d,%d,%d) iq = %lu\n", iter->first[0], iter->first[1], iter->first[2], iter->second);  fflush(fpq);
+					vector3<int> iqvec3 = qmap->iqvec3(qvec[iq]);
+					fprintf(fpq, "iqvec3 = (%d,%d,%d) iq = %lu\n", iqvec3[0], iqvec3[1], iqvec3[2], qmap->q2iq(qvec[iq]));  fflush(fpq);
 				}
 				fclose(fpq);
 			}
@@ -467,8 +469,8 @@ struct coulomb_model
 			FILE *fpk = fopen(fnamek.c_str(), "w");
 			fprintf(fpk, "\nPrint kIndexMap:\n");
 			for (size_t ik = 0; ik < elec->kvec.size(); ik++){
-				std::map<vector3<int>, size_t>::iterator iter = kmap->the_map.find(kmap->ikvec3(elec->kvec[ik]));
-				fprintf(fpk, "ikvec3 = (%d,%d,%d) ik = %lu\n", iter->first[0], iter->first[1], iter->first[2], iter->second);
+				vector3<int> ikvec3 = kmap->ikvec3(elec->kvec[ik]);
+				fprintf(fpk, "ikvec3 = (%d,%d,%d) ik = %lu\n", ikvec3[0], ikvec3[1], ikvec3[2], kmap->k2ik(elec->kvec[ik]));
 			}
 			fclose(fpk);
 		}
@@ -627,6 +629,7 @@ struct coulomb_model
 		}
 
 		calc_vq_RPA();
+		ovlps->report(mp, "screening");
 	}
 	
 	complex vq(vector3<double> q, double w = 0){
@@ -684,8 +687,7 @@ struct coulomb_model
 		}
 	}
 	void calc_ovlp(int ik, int jk){
-		hermite(elec->U[ik], Uih, elec->nb_wannier, nb);
-		zgemm_interface(ovlp, Uih, elec->U[jk], nb, nb, elec->nb_wannier);
+		ovlps->get(ovlp, ik, jk);
 	}
 	void calc_qscr2_static_RPA(){
 		qscr2_static_RPA.resize(qvec.size(), c0);
@@ -938,7 +940,7 @@ struct coulomb_model
 				w[0] = 0;
 				for (int iw = 1; iw < nw; iw++)
 					w[iw] = w[iw - 1] + dw;
-				int iq = 0;
+				int iq = 0; // or the first q after Gamma in the order of qIndexMap::build, which depends on the builder (see kmap.h)
 				double q_length_square = latt->GGT.metric_length_squared(wrap(qvec[iq]));
 				if (q_length_square < 1e-20) iq = 1;
 				q_length_square = latt->GGT.metric_length_squared(wrap(qvec[iq]));
@@ -949,6 +951,7 @@ struct coulomb_model
 				fclose(fpvqw);
 			}
 			else if (clp.dynamic == "real-axis"){
+				// iq in the order of qIndexMap::build (grid order for most k sets), so the q vector is also given in the headers
 				vector<int> iq_test_arr{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, (int)round(qvec.size() / 4) - 1, (int)round(qvec.size() / 2) - 1, (int)qvec.size() - 1 };
 				for (int iqt = 0; iqt < iq_test_arr.size(); iqt++){
 					int iq = iq_test_arr[iqt];
@@ -957,7 +960,7 @@ struct coulomb_model
 					//directly calculated qscr2 and vqw
 					string fnamevqw = "vqw_q" + int2str(iq) + ".out";
 					FILE *fpvqw = fopen(fnamevqw.c_str(), "w");
-					fprintf(fpvqw, "#w (kBT) qscr2 vqw (smearing = %7.3lf kBT |q|^2 = %14.7le)\n", clp.smearing / T, q_length_square);
+					fprintf(fpvqw, "#w (kBT) qscr2 vqw (smearing = %7.3lf kBT |q|^2 = %14.7le q = %lg %lg %lg)\n", clp.smearing / T, q_length_square, qvec[iq][0], qvec[iq][1], qvec[iq][2]);
 					for (size_t iw = 0; iw < omegaq[iq].size(); iw++)
 						fprintf(fpvqw, "%10.3le   %10.3le %10.3le   %10.3le %10.3le\n", omegaq[iq][iw].real() / T, qscr2_RPA[iq][iw].real(), qscr2_RPA[iq][iw].imag(), vq_RPA[iq][iw].real(), vq_RPA[iq][iw].imag());
 					fclose(fpvqw);
@@ -973,7 +976,7 @@ struct coulomb_model
 
 					fnamevqw = "vqw_intp_q" + int2str(iq) + ".out";
 					fpvqw = fopen(fnamevqw.c_str(), "wb");
-					fprintf(fpvqw, "#w (kBT) |vqw| ReEps ImEps |Eps| (smearing = %7.3lf kBT |q|^2 = %14.7le)\n", clp.smearing / T, q_length_square);
+					fprintf(fpvqw, "#w (kBT) |vqw| ReEps ImEps |Eps| (smearing = %7.3lf kBT |q|^2 = %14.7le q = %lg %lg %lg)\n", clp.smearing / T, q_length_square, qvec[iq][0], qvec[iq][1], qvec[iq][2]);
 					for (size_t iw = 0; iw < w.size(); iw++){
 						complex vqw = vq(qvec[iq], w[iw]);
 						complex eps = complex(prefac_vq / q_length_square, 0) / vqw;
@@ -15,7 +15,7 @@ struct elecelec_model
 	int nk, bStart, bEnd, nb, nbpow4, bStart_wannier; // bStart and bEnd relative to bStart_dm
 	double nk_full, degauss, ethr, prefac_gauss, prefac_sqrtgauss, prefac_exp_ld, prefac_exp_cv, prefac_imsig;
 	double **imsig, *delta;
-	complex *Uih, *ovlp12, *ovlp34, *ovlp32, *ovlp14, *mee, *mee_ex, *A1, *A2, *A1rho, *A1rhobar, *P1ee, *P2ee, *mtmp, *ddml, *ddmr, *A1rho_dP, *A1rhobar_dP;
+	complex *ovlp12, *ovlp34, *ovlp32, *ovlp14, *mee, *mee_ex, *A1, *A2, *A1rho, *A1rhobar, *P1ee, *P2ee, *Ptmp, *mtmp, *ddml, *ddmr, *A1rho_dP, *A1rhobar_dP;
 	double **e, **f, eStart, eEnd;
 	kIndexMap *kmap;
 
@@ -35,19 +35,18 @@ struct elecelec_model
 		prefac_imsig = M_PI / nk_full;
 
 		imsig = alloc_real_array(nk, nb);
-		Uih = new complex[nb*elec->nb_wannier]{c0};
 		ovlp12 = new complex[nb*nb]{c0}; ovlp34 = new complex[nb*nb]{c0};
 		ovlp32 = new complex[nb*nb]{c0}; ovlp14 = new complex[nb*nb]{c0};
 		delta = new double[nbpow4]{0};
 		mee = new complex[nbpow4]{c0};
 		if (eep.antisymmetry) mee_ex = new complex[nbpow4]{c0};
 		A1 = new complex[nbpow4]{c0}; A2 = new complex[nbpow4]{c0};
-		A1rho = new complex[nb*nb]{c0}; A1rhobar = new complex[nb*nb]{c0};
+		A1rho = new complex[nbpow4]{c0}; A1rhobar = new complex[nbpow4]{c0}; // one nb*nb block for each (b1,b3) in calc_P
 		mtmp = new complex[nb*nb]{c0};
-		P1ee = new complex[nbpow4]{c0}; P2ee = new complex[nbpow4]{c0};
+		P1ee = new complex[nbpow4]{c0}; P2ee = new complex[nbpow4]{c0}; Ptmp = new complex[nbpow4]{c0};
 		if (alg.linearize_dPee){
 			ddml = new complex[nb*nb]{c0}; ddmr = new complex[nb*nb]{c0};
-			A1rho_dP = new complex[nb*nb]{c0}; A1rhobar_dP = new complex[nb*nb]{c0};
+			A1rho_dP = new complex[nbpow4]{c0}; A1rhobar_dP = new complex[nbpow4]{c0};
 		}
 
 		if (bStart != coul_model->bStart || bEnd != coul_model->bEnd) error_message("bStart(bEnd) must be the same as bStart in coul_model", "elecelec_model");
@@ -59,8 +58,8 @@ struct elecelec_model
 			FILE *fpk = fopen(fnamek.c_str(), "w");
 			fprintf(fpk, "\nPrint kIndexMap:\n");
 			for (size_t ik = 0; ik < elec->kvec.size(); ik++){
-				std::map<vector3<int>, size_t>::iterator iter = kmap->the_map.find(kmap->ikvec3(elec->kvec[ik]));
-				fprintf(fpk, "ikvec3 = (%d,%d,%d) ik = %lu\n", iter->first[0], iter->first[1], iter->first[2], iter->second);
+				vector3<int> ikvec3 = kmap->ikvec3(elec->kvec[ik]);
+				fprintf(fpk, "ikvec3 = (%d,%d,%d) ik = %lu\n", ikvec3[0], ikvec3[1], ikvec3[2], kmap->k2ik(elec->kvec[ik]));
 			}
 			fclose(fpk);
 		}
@@ -74,8 +73,7 @@ struct elecelec_model
 		calc_ovlp(ovlp32, ik3, ik2);
 	}
 	void calc_ovlp(complex *ovlp, int ik, int jk, bool multply_vq = false){
-		hermite(elec->U[ik], Uih, elec->nb_wannier, nb);
-		zgemm_interface(ovlp, Uih, elec->U[jk], nb, nb, elec->nb_wannier);
+		coul_model->ovlps->get(ovlp, ik, jk);
 
 		if (!multply_vq) return;
 		if (clp.dynamic == "static"){
@@ -210,44 +208,37 @@ struct elecelec_model
 				nk3_count++;
 				for (int i1 = 0; i1 < nb; i1++)
 				for (int i3 = 0; i3 < nb; i3++){
+					int n13 = (i1*nb + i3)*nb*nb;
+					complex *A1_13 = &A1[(i1*nb + i3)*nb*nb], *A1_31 = &A1[(i3*nb + i1)*nb*nb];
 					if (alg.linearize_dPee){
-						calc_A1f(A1rho, (complex *)&A1[(i1*nb + i3)*nb*nb], f_eq[ik3], f_eq[ik4]);
-						calc_A1fbar(A1rhobar, (complex *)&A1[(i3*nb + i1)*nb*nb], f_eq[ik3], f_eq[ik4]);
-						calc_A1rho_dP(A1rho_dP, (complex *)&A1[(i1*nb + i3)*nb*nb], dm1[ik3], f1_eq[ik3], dm[ik4], f_eq[ik4]);
-						calc_A1rho_dP(A1rhobar_dP, (complex *)&A1[(i3*nb + i1)*nb*nb], dm[ik3], f_eq[ik3], dm1[ik4], f1_eq[ik4]);
+						calc_A1f(&A1rho[n13], A1_13, f_eq[ik3], f_eq[ik4]);
+						calc_A1fbar(&A1rhobar[n13], A1_31, f_eq[ik3], f_eq[ik4]);
+						calc_A1rho_dP(&A1rho_dP[n13], A1_13, dm1[ik3], f1_eq[ik3], dm[ik4], f_eq[ik4]);
+						calc_A1rho_dP(&A1rhobar_dP[n13], A1_31, dm[ik3], f_eq[ik3], dm1[ik4], f1_eq[ik4]);
 					}
 					else{
 						if (dm == nullptr){
-							calc_A1f(A1rho, (complex *)&A1[(i1*nb + i3)*nb*nb], f[ik3], f[ik4]);
-							calc_A1fbar(A1rhobar, (complex *)&A1[(i3*nb + i1)*nb*nb], f[ik3], f[ik4]);
+							calc_A1f(&A1rho[n13], A1_13, f[ik3], f[ik4]);
+							calc_A1fbar(&A1rhobar[n13], A1_31, f[ik3], f[ik4]);
 						}
 						else{
-							calc_A1rho(A1rho, (complex *)&A1[(i1*nb + i3)*nb*nb], dm1[ik3], dm[ik4]);
-							calc_A1rho(A1rhobar, (complex *)&A1[(i3*nb + i1)*nb*nb], dm[ik3], dm1[ik4]);
-						}
-					}
-
-					for (int i2 = 0; i2 < nb; i2++){
-						int n12 = (i1*nb + i2)*nb*nb;
-						for (int i4 = 0; i4 < nb; i4++){
-							int i1234 = n12 + i3*nb + i4;
-							int n24 = (i2*nb + i4)*nb*nb;
-							int n42 = (i4*nb + i2)*nb*nb;
-							for (int i6 = 0; i6 < nb; i6++)
-							for (int i8 = 0; i8 < nb; i8++){
-								int i68 = i6*nb + i8;
-								P1ee[i1234] += A1rho[i68] * conj(A2[n24 + i68]);
-								P2ee[i1234] += A1rhobar[i68] * conj(A2[n42 + i68]);
-								if (alg.linearize_dPee){
-									dP1[i1234] += A1rho_dP[i68] * conj(A2[n24 + i68]);
-									dP2[i1234] += A1rhobar_dP[i68] * conj(A2[n42 + i68]);
-								}
-							}
+							calc_A1rho(&A1rho[n13], A1_13, dm1[ik3], dm[ik4]);
+							calc_A1rho(&A1rhobar[n13], A1_31, dm[ik3], dm1[ik4]);
 						}
 					}
 				}
+				// sum over b6,b8 as matrix products, with P1ee and P2ee in the order (b1,b3),(b2,b4) and (b1,b3),(b4,b2) until the end:
+				// P1ee_{(b1,b3),(b2,b4)} += sum_{b6,b8} A1rho_{(b1,b3),(b6,b8)} A2^*_{(b2,b4),(b6,b8)}, i.e. P1ee += A1rho A2^H
+				zgemm_interface(P1ee, A1rho, A2, nb*nb, c1, c1, CblasNoTrans, CblasConjTrans);
+				zgemm_interface(P2ee, A1rhobar, A2, nb*nb, c1, c1, CblasNoTrans, CblasConjTrans);
+				if (alg.linearize_dPee){
+					zgemm_interface(dP1, A1rho_dP, A2, nb*nb, c1, c1, CblasNoTrans, CblasConjTrans);
+					zgemm_interface(dP2, A1rhobar_dP, A2, nb*nb, c1, c1, CblasNoTrans, CblasConjTrans);
+				}
 			}
 		}
+		reorder_b1b3_b2b4(P1ee, false); reorder_b1b3_b2b4(P2ee, true);
+		if (alg.linearize_dPee) { reorder_b1b3_b2b4(dP1, false); reorder_b1b3_b2b4(dP2, true); }
 		complex prefac = complex(prefac_gauss / nk_full, 0);
 		if (eep.antisymmetry) prefac *= 2;
 		axbyc(P1ee, nullptr, nbpow4, c0, prefac); // y = ax + by + c with a = 0 and b = prefac and c = 0
@@ -261,6 +252,17 @@ struct elecelec_model
 		if (imsig != nullptr) calc_imsig(ik1, ik2, P1ee, P2ee);
 		return nk3_count;
 	}
+	void reorder_b1b3_b2b4(complex *P, bool swap24){
+		// P_{(b1,b2),(b3,b4)} = P_{(b1,b3),(b2,b4)} before, or P_{(b1,b3),(b4,b2)} if swap24
+		std::copy(P, P + nbpow4, Ptmp);
+		for (int i1 = 0; i1 < nb; i1++)
+		for (int i2 = 0; i2 < nb; i2++)
+		for (int i3 = 0; i3 < nb; i3++)
+		for (int i4 = 0; i4 < nb; i4++){
+			int i24 = swap24 ? i4*nb + i2 : i2*nb + i4;
+			P[((i1*nb + i2)*nb + i3)*nb + i4] = Ptmp[(i1*nb + i3)*nb*nb + i24];
+		}
+	}
 	void calc_A1rho(complex *A1rho, complex *A1, complex *dmleft, complex *dmright){
 		// A1rho = dmleft * A1 * dmright
 		zhemm_interface(mtmp, false, dmright, A1, nb);
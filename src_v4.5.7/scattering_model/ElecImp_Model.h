@@ -16,7 +16,7 @@ struct elecimp_model
 	int nk, bStart, bEnd, nb, nbpow4, bStart_wannier; // bStart and bEnd relative to bStart_dm
 	double nk_full, degauss, ethr, prefac_A, prefac_gauss, prefac_sqrtgauss, prefac_exp_ld, prefac_exp_cv, prefac_imsig;
 	double **imsig;
-	complex *Uih, *ovlp, *eimp, *P1imp, *P2imp, *A1, *A2, *A1pp, *A1pm, *A1mp, *A1mm, *A2pp, *A2pm, *A2mp, *A2mm;
+	complex *ovlp, *eimp, *P1imp, *P2imp, *A1, *A2, *A1pp, *A1pm, *A1mp, *A1mm, *A2pp, *A2pm, *A2mp, *A2mm;
 	double **e, eStart, eEnd, omegaL;
 
 	elecimp_model(int iD, lattice *latt, parameters *param, electron *elec, int bStart, int bEnd, double eStart, double eEnd, coulomb_model *coul_model)
@@ -38,7 +38,6 @@ struct elecimp_model
 		prefac_imsig = M_PI / nk_full;
 
 		imsig = alloc_real_array(nk, nb);
-		Uih = new complex[nb*elec->nb_wannier]{c0};
 		ovlp = new complex[nb*nb];
 		eimp = new complex[nb*nb];
 		P1imp = new complex[nbpow4]{c0}; P2imp = new complex[nbpow4]{c0};
@@ -55,8 +54,7 @@ struct elecimp_model
 	}
 	
 	void calc_ovlp(int ik, int jk){
-		hermite(elec->U[ik], Uih, elec->nb_wannier, nb);
-		zgemm_interface(ovlp, Uih, elec->U[jk], nb, nb, elec->nb_wannier);
+		coul_model->ovlps->get(ovlp, ik, jk);
 	}
 	void calc_eimp(int ik, int jk){
 		calc_ovlp(ik, jk);
@@ -0,0 +1,109 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include "common_headers.h"
+#include "electron.h"
+#include "mymp.h"
+
+// cache of the overlaps <k|k'> = U_k^dagger U_k' (nb x nb), which are recomputed many times for the same (ik, ik')
+// by the Coulomb, e-i and e-e models
+// only (ik <= ik') is stored, as <k'|k> = <k|k'>^dagger
+// the memory is limited by alg_ovlp_cache_mb (0, default: no cache); when it is full, the least recently used overlap is dropped
+// with alg_ovlp_precompute, the overlaps of the k pairs of this process are computed once and never dropped
+struct ovlp_cache
+{
+	electron *elec;
+	int nk, nb;
+	size_t nslot, nslot_used, npinned; // overlaps that fit in the memory budget, stored, and kept
+	double nhit, nmiss;
+	complex *Uih, *pool;
+
+	struct entry{ size_t slot; bool pinned; std::list<size_t>::iterator it; };
+	std::unordered_map<size_t, entry> entries; // key: ik * nk + ik'
+	std::list<size_t> lru; // keys of the entries not pinned, most recently used first
+
+	ovlp_cache(electron *elec, int nb, double size_mb)
+		: elec(elec), nk(elec->nk), nb(nb), nslot_used(0), npinned(0), nhit(0), nmiss(0), pool(nullptr)
+	{
+		Uih = new complex[nb*elec->nb_wannier]{c0};
+		nslot = size_mb > 0 ? (size_t)(size_mb * 1048576 / (nb * nb * sizeof(complex))) : 0;
+		nslot = std::min(nslot, (size_t)nk * (nk + 1) / 2);
+		if (nslot > 0) pool = new complex[nslot*nb*nb];
+		entries.reserve(nslot);
+		if (ionode && nslot > 0) printf("overlap cache: %lu overlaps (%.1lf MB)\n", nslot, nslot * nb * nb * sizeof(complex) / 1048576.);
+	}
+	~ovlp_cache(){
+		delete[] Uih;
+		if (pool != nullptr) delete[] pool;
+	}
+
+	void calc(complex *ovlp, int ik, int jk){
+		hermite(elec->U[ik], Uih, elec->nb_wannier, nb);
+		zgemm_interface(ovlp, Uih, elec->U[jk], nb, nb, elec->nb_wannier);
+	}
+
+	// ovlp = <ik|jk>
+	void get(complex *ovlp, int ik, int jk){
+		if (nslot == 0) { calc(ovlp, ik, jk); return; }
+		bool swap = ik > jk;
+		complex *o = find(swap ? jk : ik, swap ? ik : jk, false);
+		if (o == nullptr){ // all slots are pinned
+			calc(ovlp, ik, jk); return;
+		}
+		if (swap) hermite(o, ovlp, nb);
+		else std::copy(o, o + nb*nb, ovlp);
+	}
+
+	// overlaps of the k pairs of this process, kept until the end
+	void precompute(mymp *mp, int nkpair, size_t *k1st, size_t *k2nd){
+		if (nslot == 0) { if (ionode) printf("overlap cache: no memory budget, overlaps are not precomputed\n"); return; }
+		int nskip = 0;
+		for (int ikpair = 0; ikpair < nkpair; ikpair++){
+			int ik = std::min(k1st[ikpair], k2nd[ikpair]), jk = std::max(k1st[ikpair], k2nd[ikpair]);
+			if (npinned == nslot) { nskip++; continue; }
+			find(ik, jk, true);
+		}
+		nhit = 0; nmiss = 0;
+		double npin = npinned, nskip_tot = nskip;
+		mp->allreduce(npin, MPI_SUM); mp->allreduce(nskip_tot, MPI_SUM);
+		if (ionode) printf("overlap cache: %.0lf overlaps of local k pairs precomputed, %.0lf not kept (memory budget)\n", npin, nskip_tot);
+	}
+
+	// hit rate since the last report, summed over the processes of mp; collective
+	void report(mymp *mp, string what){
+		if (nslot == 0) return;
+		double hit = nhit, miss = nmiss;
+		mp->allreduce(hit, MPI_SUM); mp->allreduce(miss, MPI_SUM);
+		if (ionode) printf("overlap cache (%s): hits= %.0lf misses= %.0lf hit rate= %.4lf\n", what.c_str(), hit, miss, hit + miss > 0 ? hit / (hit + miss) : 0.);
+		nhit = 0; nmiss = 0;
+	}
+
+private:
+	// stored <ik|jk> with ik <= jk, computed if not stored; nullptr if there is no slot for it
+	complex* find(int ik, int jk, bool pin){
+		size_t key = (size_t)ik * nk + jk;
+		auto it = entries.find(key);
+		if (it != entries.end()){
+			nhit++;
+			entry &en = it->second;
+			if (pin && !en.pinned) { lru.erase(en.it); en.pinned = true; npinned++; }
+			else if (!en.pinned) lru.splice(lru.begin(), lru, en.it);
+			return &pool[en.slot*nb*nb];
+		}
+		nmiss++;
+		size_t slot;
+		if (nslot_used < nslot) slot = nslot_used++;
+		else if (!lru.empty()){
+			auto old = entries.find(lru.back());
+			slot = old->second.slot;
+			entries.erase(old); lru.pop_back();
+		}
+		else return nullptr;
+		entry en; en.slot = slot; en.pinned = pin;
+		if (pin) npinned++;
+		else { lru.push_front(key); en.it = lru.begin(); }
+		entries[key] = en;
+		calc(&pool[slot*nb*nb], ik, jk);
+		return &pool[slot*nb*nb];
+	}
+};
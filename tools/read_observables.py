@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# read observables.bin written with ob_format = binary
+#   python3 read_observables.py [observables.bin]           list the time series
+#   python3 read_observables.py [observables.bin] --export  write the text files, e.g. sz_elec_tot.out
+# in python: from read_observables import read; data = read("observables.bin"); data["sz_elec_tot.out"] is an (nt, ncol) array
+import struct
+import sys
+import numpy as np
+
+def read(fname="observables.bin"):
+    """returns {name: array (nt, ncol)} and {name: header}"""
+    with open(fname, "rb") as f:
+        buf = f.read()
+    if buf[:8] != b"DMDOBS01":
+        raise ValueError(fname + " is not an observables container")
+    pos = 8
+    ids, rows, headers = {}, {}, {}
+    while pos < len(buf):
+        tag, = struct.unpack_from("<i", buf, pos); pos += 4
+        if tag == -1:
+            # series declaration; a restarted run declares its series again
+            sid, ncol, lname = struct.unpack_from("<iii", buf, pos); pos += 12
+            name = buf[pos:pos+lname].decode(); pos += lname
+            lheader, = struct.unpack_from("<i", buf, pos); pos += 4
+            headers[name] = buf[pos:pos+lheader].decode(); pos += lheader
+            ids[sid] = (name, ncol)
+            rows.setdefault(name, [])
+        else:
+            name, ncol = ids[tag]
+            if pos + 8*ncol > len(buf):
+                break # incomplete last row of a run that was killed
+            rows[name].append(np.frombuffer(buf, dtype="<f8", count=ncol, offset=pos)); pos += 8*ncol
+    data = {name: np.array(r).reshape(len(r), -1) for name, r in rows.items()}
+    return data, headers
+
+def export(data, headers):
+    """text files in the format of ob_format = text"""
+    for name, a in data.items():
+        with open(name, "w") as f:
+            f.write(headers[name])
+            for row in a:
+                f.write(" 0.00000000000000e+01" if abs(row[0]) < 1e-30 else "%21.14e" % row[0])
+                f.write("".join(" %21.14e" % x for x in row[1:]) + "\n")
+
+if __name__ == "__main__":
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    data, headers = read(args[0] if args else "observables.bin")
+    if "--export" in sys.argv:
+        export(data, headers)
+    for name, a in data.items():
+        print("%-32s %8d rows %4d columns" % (name, a.shape[0], a.shape[1]))